@@ -0,0 +1,122 @@
+
+#ifndef _DECAF_ARENA
+#define _DECAF_ARENA
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+/// decafArena - bump allocator owning the AST nodes and token text of one
+/// compilation. Memory is carved out of large chunks and released all at
+/// once by reset(); objects with non-trivial destructors (strings, lists)
+/// are registered with own() and destroyed in one flat pass, so freeing
+/// a deep tree never recurses.
+class decafArena {
+	struct chunk {
+		chunk *next;
+		size_t size;
+		size_t used;
+	};
+	struct finalizer {
+		void (*destroy)(void *);
+		void *obj;
+		finalizer *next;
+	};
+	static const size_t chunkSize = 64 * 1024;
+	static const size_t align = alignof(max_align_t);
+	static const size_t header = (sizeof(chunk) + align - 1) & ~(align - 1);
+
+	chunk *head;
+	finalizer *finalizers;
+	size_t numChunks;
+	size_t bytesReserved;
+	size_t bytesUsed;
+	size_t numNodes;
+	size_t numStrings;
+
+	template <class T>
+	static void destroy(void *p) { static_cast<T *>(p)->~T(); }
+
+	void newChunk(size_t size) {
+		size_t total = header + (size > chunkSize ? size : (size_t)chunkSize);
+		chunk *c = (chunk *)malloc(total);
+		if (c == NULL) {
+			throw bad_alloc();
+		}
+		c->next = head;
+		c->size = total - header;
+		c->used = 0;
+		head = c;
+		numChunks++;
+		bytesReserved += total;
+	}
+public:
+	decafArena() : head(NULL), finalizers(NULL), numChunks(0), bytesReserved(0), bytesUsed(0), numNodes(0), numStrings(0) {}
+	~decafArena() { reset(); }
+
+	void *allocate(size_t size) {
+		size = (size + align - 1) & ~(align - 1);
+		if (head == NULL || head->used + size > head->size) {
+			newChunk(size);
+		}
+		void *p = (char *)head + header + head->used;
+		head->used += size;
+		bytesUsed += size;
+		return p;
+	}
+
+	// register an arena object whose destructor must run on reset()
+	template <class T>
+	void own(T *obj) {
+		finalizer *f = (finalizer *)allocate(sizeof(finalizer));
+		f->destroy = &destroy<T>;
+		f->obj = obj;
+		f->next = finalizers;
+		finalizers = f;
+	}
+	void countNode() { numNodes++; }
+
+	// token text, owned by the arena
+	string *newString(const char *s, size_t len) {
+		string *str = new (allocate(sizeof(string))) string(s, len);
+		own(str);
+		numStrings++;
+		return str;
+	}
+	string *newString(const string &s) { return newString(s.data(), s.size()); }
+
+	// raw copy of token text for input that is not memory-mapped
+	const char *copyText(const char *s, size_t len) {
+		char *p = (char *)allocate(len + 1);
+		memcpy(p, s, len);
+		p[len] = '\0';
+		numStrings++;
+		return p;
+	}
+
+	// free every object and chunk in one pass
+	void reset() {
+		for (finalizer *f = finalizers; f != NULL; f = f->next) {
+			f->destroy(f->obj);
+		}
+		finalizers = NULL;
+		while (head != NULL) {
+			chunk *next = head->next;
+			free(head);
+			head = next;
+		}
+	}
+
+	void printStats(ostream &os) {
+		os << "arena: " << numNodes << " nodes, " << numStrings << " strings, "
+		   << bytesUsed << " bytes used of " << bytesReserved << " bytes in "
+		   << numChunks << " chunks" << endl;
+	}
+};
+
+#endif
@@ -1,5 +1,6 @@
 
 #include "default-defs.h"
+#include "decaf-print.h"
 #include <list>
 #include <ostream>
 #include <iostream>
@@ -11,31 +12,49 @@
 
 using namespace std;
 
+// owns every AST node and token string of the current compilation
+decafArena astArena;
+
 /// decafAST - Base class for all abstract syntax tree nodes.
 class decafAST {
 public:
+  // nodes live in astArena and are freed together by astArena.reset()
+  static void *operator new(size_t size) { return astArena.allocate(size); }
+  static void operator delete(void *) {}
+  decafAST() { astArena.own(this); astArena.countNode(); }
   virtual ~decafAST() {}
-  virtual string str() { return string(""); }
+  virtual void print(astSink &out) {}
+  // the printed form of a single node, e.g. an identifier or array size
+  string str() { astSink s; print(s); return s.str(); }
 };
 
-string getString(decafAST *d) {
+astSink &operator<<(astSink &out, decafAST *d) {
 	if (d != NULL) {
-		return d->str();
+		d->print(out);
 	} else {
-		return string("None");
+		out << "None";
 	}
+	return out;
+}
+
+string getString(decafAST *d) {
+	astSink s;
+	s << d;
+	return s.str();
 }
 
 template <class T>
-string commaList(list<T> vec) {
-    string s("");
-    for (typename list<T>::iterator i = vec.begin(); i != vec.end(); i++) { 
-        s = s + (s.empty() ? string("") : string(",")) + (*i)->str(); 
-    }   
-    if (s.empty()) {
-        s = string("None");
-    }   
-    return s;
+void printList(astSink &out, const list<T> &vec) {
+	if (vec.empty()) {
+		out << "None";
+		return;
+	}
+	for (typename list<T>::const_iterator i = vec.begin(); i != vec.end(); i++) {
+		if (i != vec.begin()) {
+			out << ",";
+		}
+		out << *i;
+	}
 }
 
 /// decafStmtList - List of Decaf statements
@@ -43,16 +62,11 @@ class decafStmtList : public decafAST {
 	list<decafAST *> stmts;
 public:
 	decafStmtList() {}
-	~decafStmtList() {
-		for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++) { 
-			delete *i;
-		}
-	}
 	int size() { return stmts.size(); }
 	decafAST* lastElement() { return stmts.back(); }
 	void push_front(decafAST *e) { stmts.push_front(e); }
 	void push_back(decafAST *e) { stmts.push_back(e); }
-	string str() { return commaList<class decafAST *>(stmts); }
+	void print(astSink &out) { printList(out, stmts); }
 };
 
 class PackageAST : public decafAST {
@@ -62,12 +76,8 @@ class PackageAST : public decafAST {
 public:
 	PackageAST(string name, decafStmtList *fieldlist, decafStmtList *methodlist) 
 		: Name(name), FieldDeclList(fieldlist), MethodDeclList(methodlist) {}
-	~PackageAST() { 
-		if (FieldDeclList != NULL) { delete FieldDeclList; }
-		if (MethodDeclList != NULL) { delete MethodDeclList; }
-	}
-	string str() { 
-		return string("Package") + "(" + Name + "," + getString(FieldDeclList) + "," + getString(MethodDeclList) + ")";
+	void print(astSink &out) {
+		out << "Package(" << Name << "," << FieldDeclList << "," << MethodDeclList << ")";
 	}
 };
 
@@ -77,11 +87,7 @@ class ProgramAST : public decafAST {
 	PackageAST *PackageDef;
 public:
 	ProgramAST(decafStmtList *externs, PackageAST *c) : ExternList(externs), PackageDef(c) {}
-	~ProgramAST() { 
-		if (ExternList != NULL) { delete ExternList; } 
-		if (PackageDef != NULL) { delete PackageDef; }
-	}
-	string str() { return string("Program") + "(" + getString(ExternList) + "," + getString(PackageDef) + ")"; }
+	void print(astSink &out) { out << "Program(" << ExternList << "," << PackageDef << ")"; }
 };
 
 class BlockAST : public decafAST {
@@ -89,11 +95,7 @@ class BlockAST : public decafAST {
 	decafStmtList *statement_list;
 public:
 	BlockAST(decafStmtList* vList, decafStmtList* sList): varDefList(vList), statement_list(sList) {} 
-	~BlockAST(){ 
-		if(varDefList != NULL) {delete varDefList;}
-		if(statement_list != NULL) {delete statement_list;}
-	}
-	string str() { return string("Block") + "(" + getString(varDefList) + "," + getString(statement_list) + ")"; }
+	void print(astSink &out) { out << "Block(" << varDefList << "," << statement_list << ")"; }
 
 };
 
@@ -103,20 +105,20 @@ class VarDefAST : public decafAST {
 public:
 	VarDefAST(string name, string type): Name(name), Type(type) {}
 	string returnType() { return Type;}
-	string str() {return string("VarDef") + "(" + Name + "," + Type + ")" ;}
+	void print(astSink &out) { out << "VarDef(" << Name << "," << Type << ")"; }
 
 };
 
 class BreakStatementAST : public decafAST {
 public:
 	BreakStatementAST() {}
-	string str() {return string("BreakStmt");}
+	void print(astSink &out) { out << "BreakStmt"; }
 };
 
 class ContinueStatementAST: public decafAST {
 public:
 	ContinueStatementAST() {}
-	string str() {return string("ContinueStmt");}
+	void print(astSink &out) { out << "ContinueStmt"; }
 };
 
 class ReturnStatementAST: public decafAST {
@@ -124,8 +126,7 @@ class ReturnStatementAST: public decafAST {
 public:
 	ReturnStatementAST(decafAST *input): expr(input) {}
 	ReturnStatementAST(): expr(NULL) {}
-	~ReturnStatementAST() {if (expr != NULL) { delete expr; } }
-	string str() { return string("ReturnStmt") + "(" + getString(expr) + ")" ;}
+	void print(astSink &out) { out << "ReturnStmt(" << expr << ")"; }
 };
 
 
@@ -136,13 +137,7 @@ class ForStmtAST: public decafAST {
 	decafAST *block;
 public:
 	ForStmtAST(decafStmtList *pre, decafAST* constant, decafStmtList *loop, decafAST *inputBlock): pre_assign_list(pre), loop_assign(loop), expr(constant), block(inputBlock) {}
-	~ForStmtAST() { 
-		if (pre_assign_list != NULL) { delete pre_assign_list; } 
-		if (loop_assign != NULL) { delete loop_assign; }
-		if (expr != NULL) { delete expr; }
-		if (block != NULL) { delete block; }
-	}
-	string str() {return string("ForStmt") + "(" + getString(pre_assign_list) + "," + getString(expr) + "," + getString(loop_assign) + ","+ getString(block)  + ")" ;}
+	void print(astSink &out) { out << "ForStmt(" << pre_assign_list << "," << expr << "," << loop_assign << "," << block << ")"; }
 };
 
 class IfStmtAST: public decafAST {
@@ -152,12 +147,7 @@ class IfStmtAST: public decafAST {
 public:
 	IfStmtAST(decafAST* inputExpr, decafAST* inputBlock, decafAST* inputElse): expr(inputExpr), block(inputBlock), elseBlock(inputElse) {}
 	IfStmtAST(decafAST* inputExpr, decafAST* inputBlock): expr(inputExpr), block(inputBlock) { elseBlock = NULL;}
-	~IfStmtAST() { 
-		if (block != NULL) { delete block; } 
-		if (expr != NULL) { delete expr; }
-		if (elseBlock != NULL) { delete elseBlock; }
-	}
-	string str() {return string("IfStmt") + "("+ getString(expr) + "," + getString(block) + "," + getString(elseBlock) +")";}
+	void print(astSink &out) { out << "IfStmt(" << expr << "," << block << "," << elseBlock << ")"; }
 };
 
 
@@ -166,11 +156,7 @@ class WhileStmtAST: public decafAST {
 	decafAST *block;
 public:
 	WhileStmtAST(decafAST* inputExpr, decafAST* inputBlock): expr(inputExpr), block(inputBlock) {}
-	~WhileStmtAST() { 
-		if (block != NULL) { delete block; } 
-		if (expr != NULL) { delete expr; }
-	}
-	string str() {return string("WhileStmt") + "("+ getString(expr) + "," + getString(block) + ")";}
+	void print(astSink &out) { out << "WhileStmt(" << expr << "," << block << ")"; }
 };
 
 class MethodCallAST	: public decafAST {
@@ -178,11 +164,8 @@ class MethodCallAST	: public decafAST {
 	decafStmtList *method_arg_list;
 public:
 	MethodCallAST(string name, decafStmtList *mArgList): Name(name), method_arg_list(mArgList) {}
-	~MethodCallAST() { 
-		if (method_arg_list != NULL) { delete method_arg_list; }
-	}
-	string str() { 
-		return string("MethodCall") + "(" + Name + "," + getString(method_arg_list) + ")";
+	void print(astSink &out) {
+		out << "MethodCall(" << Name << "," << method_arg_list << ")";
 	}
 };
 
@@ -192,8 +175,7 @@ class AssignVarAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignVarAST(string name, decafAST* expr): Name(name), Expr(expr) {}
-	~AssignVarAST() { if(Expr != NULL) { delete Expr; }}
-	string str() { return string("AssignVar") + "("+ Name + "," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignVar(" << Name << "," << Expr << ")"; }
 };
 
 //AssignArrayLoc(identifier name, expr index, expr value)
@@ -202,11 +184,7 @@ class AssignArrayLocAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignArrayLocAST(decafAST* lval ,decafAST* expr): Lval(lval) ,Expr(expr) {}
-	~AssignArrayLocAST() { 
-		if(Expr != NULL) { delete Expr; }
-		if(Lval != NULL) { delete Lval; }
-	}
-	string str() { return string("AssignArrayLoc") + "("+ getString(Lval) +"," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignArrayLoc(" << Lval << "," << Expr << ")"; }
 };
 
 
@@ -215,7 +193,7 @@ class MethodArgAST: public decafAST {
 	string Value;
 public:
 	MethodArgAST(string value): Value(value) {}
-	string str() { return string("StringConstant") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "StringConstant(" << Value << ")"; }
 };
 
 
@@ -223,7 +201,7 @@ class VariableExprAST: public decafAST {
 	string Name;
 public:
 	VariableExprAST(string name): Name(name) {}
-	string str() { return string("VariableExpr") + "(" + Name + ")" ;}
+	void print(astSink &out) { out << "VariableExpr(" << Name << ")"; }
 };
 
 
@@ -233,8 +211,7 @@ class ArrayLocExprAST : public decafAST {
 	decafAST* Index;
 public:
 	ArrayLocExprAST(string name, decafAST* index): Name(name), Index(index) {}
-	~ArrayLocExprAST() { if(Index != NULL) { delete Index; }}
-	string str() { return string("ArrayLocExpr") + "("+ Name + "," + getString(Index) + ")" ;}
+	void print(astSink &out) { out << "ArrayLocExpr(" << Name << "," << Index << ")"; }
 };
 
  
@@ -243,8 +220,7 @@ class ArrayLValAST : public decafAST {
 	decafAST* Index;
 public:
 	ArrayLValAST(string name, decafAST* index): Name(name), Index(index) {}
-	~ArrayLValAST() { if(Index != NULL) { delete Index; }}
-	string str() { return string( Name + "," + getString(Index) ) ;}
+	void print(astSink &out) { out << Name << "," << Index; }
 };
 
 
@@ -256,7 +232,7 @@ class NumberExprAST: public decafAST {
 	string Value;
 public:
 	NumberExprAST(string value): Value(value) {}
-	string str() { return string("NumberExpr") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "NumberExpr(" << Value << ")"; }
 };
 
 
@@ -264,7 +240,7 @@ class BoolExprAST: public decafAST {
 	string Value;
 public:
 	BoolExprAST(string value): Value(value) {}
-	string str() { return string("BoolExpr") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "BoolExpr(" << Value << ")"; }
 };
 
 //BinaryExpr(binary_operator op, expr left_value, expr right_value)
@@ -275,11 +251,7 @@ class BinaryExprAST : public decafAST {
 	decafAST* Right;
 public:
 	BinaryExprAST(string op,decafAST* left ,decafAST* right): Op(op), Left(left) , Right(right) {}
-	~BinaryExprAST() { 
-		if(Left != NULL) { delete Left; }
-		if(Right != NULL) { delete Right; }
-	}
-	string str() { return string("BinaryExpr") + "("+ Op + "," + getString(Left) +"," + getString(Right) + ")" ;}
+	void print(astSink &out) { out << "BinaryExpr(" << Op << "," << Left << "," << Right << ")"; }
 };
 
 
@@ -289,8 +261,7 @@ class UnaryExprAST : public decafAST {
 	decafAST* Value;
 public:
 	UnaryExprAST(string op, decafAST* value): Op(op), Value(value) {}
-	~UnaryExprAST() { if(Value != NULL) { delete Value; }}
-	string str() { return string("UnaryExpr") + "("+ Op + "," + getString(Value) + ")" ;}
+	void print(astSink &out) { out << "UnaryExpr(" << Op << "," << Value << ")"; }
 };
 
 
@@ -299,11 +270,7 @@ class MethodBlockAST : public decafAST {
 	decafStmtList *statement_list;
 public:
 	MethodBlockAST(decafStmtList* vList, decafStmtList* sList): varDefList(vList), statement_list(sList) {} 
-	~MethodBlockAST(){ 
-		if(varDefList != NULL) {delete varDefList;}
-		if(statement_list != NULL) {delete statement_list;}
-	}
-	string str() { return string("MethodBlock") + "(" + getString(varDefList) + "," + getString(statement_list) + ")"; }
+	void print(astSink &out) { out << "MethodBlock(" << varDefList << "," << statement_list << ")"; }
 
 };
 
@@ -315,11 +282,7 @@ class MethodDeclAST: public decafAST {
 	decafAST* MBlock;
 public:
 	MethodDeclAST(string name, decafStmtList* list, string type, decafAST* block ) : Name(name), DecVarList(list), MType(type), MBlock(block) {}
-	~MethodDeclAST(){ 
-		if(DecVarList != NULL) {delete DecVarList;}
-		if(MBlock != NULL) {delete MBlock;}
-	}
-	string str() { return string("Method") + "("+ Name + "," + MType + "," + getString(DecVarList) + "," + getString(MBlock)+ ")"; }
+	void print(astSink &out) { out << "Method(" << Name << "," << MType << "," << DecVarList << "," << MBlock << ")"; }
 
 };
 
@@ -327,7 +290,7 @@ class ParenExprAST: public decafAST {
 	decafAST* Value;
 public:
 	ParenExprAST(decafAST* value): Value(value) {}
-	string str() { return "(" + getString(Value) + ")" ;}
+	void print(astSink &out) { out << "(" << Value << ")"; }
 };
 
 // VarDef(StringType) | VarDef(decaf_type)
@@ -335,7 +298,7 @@ class ExternTypeAST : public decafAST {
 	string Name;
 public:
 	ExternTypeAST(string name): Name(name) {}
-	string str() { return string("VarDef") + "(" + Name + ")" ;}
+	void print(astSink &out) { out << "VarDef(" << Name << ")"; }
 };
 
 
@@ -348,8 +311,7 @@ class ExternFunctionAST : public decafAST {
 	decafAST* InputType;
 public:
 	ExternFunctionAST(string name, string returnType, decafAST* inputType): Name(name), ReturnType(returnType), InputType(inputType) {}
-	~ExternFunctionAST() { if(InputType != NULL) {delete InputType;}}
-	string str() { return string("ExternFunction") + "(" + Name + "," + ReturnType + "," + getString(InputType) + ")" ;}
+	void print(astSink &out) { out << "ExternFunction(" << Name << "," << ReturnType << "," << InputType << ")"; }
 };
 
 
@@ -364,12 +326,9 @@ class FieldDeclAST : public decafAST {
 
 public:
 	FieldDeclAST(decafAST* name, string type, string fSize): Name(name), Type(type), FSize(fSize) {}
-	~FieldDeclAST() {
-		if(Name != NULL) {delete Name;}
-	}
 	string returnType() { return Type;}
 	string returnArr() { return FSize;}
-	string str() {return string("FieldDecl") + "(" + getString(Name) + "," + Type + "," + FSize + ")" ;}
+	void print(astSink &out) { out << "FieldDecl(" << Name << "," << Type << "," << FSize << ")"; }
 };
 
 
@@ -379,14 +338,14 @@ class ArrayAST: public decafAST {
 	string ArrSize;
 public:
 	ArrayAST(string arrSize): ArrSize(arrSize) {}
-	string str() { return string("Array") + "(" + ArrSize + ")" ;}
+	void print(astSink &out) { out << "Array(" << ArrSize << ")"; }
 };
 
 
 class ScalarAST: public decafAST {
 public:
 	ScalarAST() {}
-	string str() {return string("Scalar");}
+	void print(astSink &out) { out << "Scalar"; }
 };
 
 //AssignGlobalVar(identifier name, decaf_type type, expr value)
@@ -397,8 +356,7 @@ class AssignGlobalVarAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignGlobalVarAST(string name, string type, decafAST* expr): Name(name), Type(type), Expr(expr) {}
-	~AssignGlobalVarAST() {if(Expr != NULL) {delete Expr;}}
-	string str() {return string("AssignGlobalVar") + "(" + Name + "," + Type + "," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignGlobalVar(" << Name << "," << Type << "," << Expr << ")"; }
 };
 
 
@@ -410,7 +368,6 @@ class MethodAST : public decafAST {
 	decafAST* MBlock;
 public:
 	MethodAST(string name, string type, decafAST* mBlock): Name(name), Type(Type), MBlock(mBlock) {}
-	~MethodAST() {if(MBlock != NULL) {delete MBlock;}}
 	string str() {return string("FieldDecl") + "(" + Name + "," + Type + "," + getString(MBlock) + ")" ;}
 };
 */
@@ -419,7 +376,7 @@ class IdAST: public decafAST {
 	string Name;
 public:
 	IdAST(string name): Name(name) {}
-	string str() {return Name;}
+	void print(astSink &out) { out << Name; }
 };
 
 
@@ -428,6 +385,6 @@ class DecVarAST : public decafAST {
 	string Type;
 public:
 	DecVarAST(string name, string type): Name(name), Type(type) {}
-	string str() {return string("(") + Name + "," + Type + ")" ;}
+	void print(astSink &out) { out << "(" << Name << "," << Type << ")"; }
 
 };
\ No newline at end of file
@@ -8,10 +8,23 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include "decaf-arena.h"
 
 
 extern int lineno;
 extern int tokenpos;
+extern decafArena astArena;
+
+// token text passed from the lexer to the parser: a view into the
+// memory-mapped source, or into the arena when the input is a pipe
+struct tokenText {
+	const char *ptr;
+	int len;
+	std::string str() const { return std::string(ptr, len); }
+};
+
+// scan straight from a memory mapping of fd, returns 0 if fd is not a file
+int yymapinput(int fd);
 
 using namespace std;
 
@@ -0,0 +1,49 @@
+"""
+Time the decafast AST printer on generated inputs of growing size.
+
+First build decafast in ../answer/, then run:
+
+    python3 benchprint.py
+
+For each size it generates a package with genstmts.py, runs
+`decafast --no-trace --stats` on it and reports the best of a few runs:
+the whole run and the time decafast reports for printing alone. With
+a linear printer the time per statement stays about the same as the
+input grows. The parse trace is turned off because it costs more than
+everything else on inputs this large.
+"""
+
+import os, sys, optparse, subprocess, tempfile, time
+import genstmts
+
+def run(decafast, path):
+    with open(path) as source:
+        start = time.perf_counter()
+        prog = subprocess.run([decafast, "--no-trace", "--stats"], stdin=source, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+        elapsed = time.perf_counter() - start
+    if prog.returncode != 0:
+        raise RuntimeError("{} failed on {}".format(decafast, path))
+    for line in prog.stderr.splitlines():
+        if line.startswith("print: "):
+            return elapsed, float(line.split()[1]) / 1000
+    raise RuntimeError("{} did not report the printing time".format(decafast))
+
+if __name__ == '__main__':
+    bench_dir = os.path.dirname(os.path.abspath(sys.argv[0]))
+    optparser = optparse.OptionParser()
+    optparser.add_option("-a", "--answerdir", dest="answer_dir", default=os.path.join(bench_dir, "..", "answer"), help="answer directory [default: ../answer]")
+    optparser.add_option("-s", "--sizes", dest="sizes", default="12500,25000,50000,100000", help="statement counts [default: 12500,25000,50000,100000]")
+    optparser.add_option("-r", "--runs", dest="runs", type="int", default=3, help="runs per size, the best is reported [default: 3]")
+    (opts, _) = optparser.parse_args()
+
+    decafast = os.path.abspath(os.path.join(opts.answer_dir, "decafast"))
+    print("{:>10} {:>10} {:>10} {:>14}".format("statements", "run (s)", "print (s)", "print/stmt (us)"))
+    for size in [int(s) for s in opts.sizes.split(",")]:
+        fd, path = tempfile.mkstemp(".decaf")
+        try:
+            with os.fdopen(fd, "w") as out:
+                genstmts.generate(size, 100, out)
+            best = min(run(decafast, path) for _ in range(opts.runs))
+        finally:
+            os.remove(path)
+        print("{:>10} {:>10.3f} {:>10.3f} {:>14.3f}".format(size, best[0], best[1], best[1] / size * 1e6))
@@ -0,0 +1,31 @@
+"""
+Generate a large Decaf package for timing the AST printer.
+
+    python3 genstmts.py -s 50000 > big.decaf
+
+The package has methods of a fixed number of assignment statements,
+as many as it takes to reach the requested statement count. Long
+statement lists are split across methods because bison's default stack
+holds only 10000 entries and the statement list is right recursive.
+"""
+
+import sys, optparse
+
+def generate(statements, per_method, out):
+    methods = max(1, (statements + per_method - 1) // per_method)
+    out.write("extern func print_int(int) void;\n")
+    out.write("package Big {\n")
+    for m in range(methods):
+        out.write("\tfunc m%d(a int) int {\n\t\tvar x int;\n" % m)
+        for i in range(min(per_method, statements - m * per_method)):
+            out.write("\t\tx = x + a * %d;\n" % i)
+        out.write("\t\treturn x;\n\t}\n")
+    out.write("\tfunc main() int { print_int(m0(1)); }\n")
+    out.write("}\n")
+
+if __name__ == '__main__':
+    optparser = optparse.OptionParser()
+    optparser.add_option("-s", "--statements", dest="statements", type="int", default=50000, help="number of statements [default: 50000]")
+    optparser.add_option("-m", "--per-method", dest="per_method", type="int", default=100, help="statements per method [default: 100]")
+    (opts, _) = optparser.parse_args()
+    generate(opts.statements, opts.per_method, sys.stdout)
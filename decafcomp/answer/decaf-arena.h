@@ -0,0 +1,199 @@
+
+#ifndef _DECAF_ARENA
+#define _DECAF_ARENA
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <ostream>
+
+using namespace std;
+
+/// decafArena - bump allocator owning the AST nodes and token text of one
+/// compilation. Memory is carved out of large chunks and released all at
+/// once by reset(); objects with non-trivial destructors (nodes holding lists)
+/// are registered with own() and destroyed in one flat pass, so freeing
+/// a deep tree never recurses.
+class decafArena {
+	struct chunk {
+		chunk *next;
+		size_t size;
+		size_t used;
+	};
+	struct finalizer {
+		void (*destroy)(void *);
+		void *obj;
+		finalizer *next;
+	};
+	static const size_t chunkSize = 64 * 1024;
+	static const size_t align = alignof(max_align_t);
+	static const size_t header = (sizeof(chunk) + align - 1) & ~(align - 1);
+
+	chunk *head;
+	finalizer *finalizers;
+	size_t numChunks;
+	size_t bytesReserved;
+	size_t bytesUsed;
+	size_t numNodes;
+	size_t numStrings;
+
+	template <class T>
+	static void destroy(void *p) { static_cast<T *>(p)->~T(); }
+
+	void newChunk(size_t size) {
+		size_t total = header + (size > chunkSize ? size : (size_t)chunkSize);
+		chunk *c = (chunk *)malloc(total);
+		if (c == NULL) {
+			throw bad_alloc();
+		}
+		c->next = head;
+		c->size = total - header;
+		c->used = 0;
+		head = c;
+		numChunks++;
+		bytesReserved += total;
+	}
+public:
+	decafArena() : head(NULL), finalizers(NULL), numChunks(0), bytesReserved(0), bytesUsed(0), numNodes(0), numStrings(0) {}
+	~decafArena() { reset(); }
+
+	void *allocate(size_t size) {
+		size = (size + align - 1) & ~(align - 1);
+		if (head == NULL || head->used + size > head->size) {
+			newChunk(size);
+		}
+		void *p = (char *)head + header + head->used;
+		head->used += size;
+		bytesUsed += size;
+		return p;
+	}
+
+	// register an arena object whose destructor must run on reset()
+	template <class T>
+	void own(T *obj) {
+		finalizer *f = (finalizer *)allocate(sizeof(finalizer));
+		f->destroy = &destroy<T>;
+		f->obj = obj;
+		f->next = finalizers;
+		finalizers = f;
+	}
+	void countNode() { numNodes++; }
+
+	// raw copy of token text for input that is not memory-mapped
+	const char *copyText(const char *s, size_t len) {
+		char *p = (char *)allocate(len + 1);
+		memcpy(p, s, len);
+		p[len] = '\0';
+		numStrings++;
+		return p;
+	}
+
+	// a point in the allocation sequence to roll back to
+	struct position {
+		chunk *head;
+		size_t used;
+		finalizer *finalizers;
+		size_t bytesUsed;
+		size_t numNodes;
+		size_t numStrings;
+	};
+	position mark() const {
+		position p = { head, head != NULL ? head->used : 0, finalizers, bytesUsed, numNodes, numStrings };
+		return p;
+	}
+	// free everything allocated since p, e.g. the AST of a method that
+	// has been compiled, while keeping what came before it
+	void release(const position &p) {
+		for (finalizer *f = finalizers; f != p.finalizers; f = f->next) {
+			f->destroy(f->obj);
+		}
+		finalizers = p.finalizers;
+		while (head != p.head) {
+			chunk *next = head->next;
+			bytesReserved -= header + head->size;
+			numChunks--;
+			free(head);
+			head = next;
+		}
+		if (head != NULL) {
+			head->used = p.used;
+		}
+		bytesUsed = p.bytesUsed;
+		numNodes = p.numNodes;
+		numStrings = p.numStrings;
+	}
+
+	// free every object and chunk in one pass
+	void reset() {
+		for (finalizer *f = finalizers; f != NULL; f = f->next) {
+			f->destroy(f->obj);
+		}
+		finalizers = NULL;
+		while (head != NULL) {
+			chunk *next = head->next;
+			free(head);
+			head = next;
+		}
+		numChunks = bytesReserved = bytesUsed = numNodes = numStrings = 0;
+	}
+
+	void printStats(ostream &os) {
+		os << "arena: " << numNodes << " nodes, " << numStrings << " strings, "
+		   << bytesUsed << " bytes used of " << bytesReserved << " bytes in "
+		   << numChunks << " chunks" << endl;
+	}
+};
+
+/// arenaVector - contiguous list with N inline slots that spills into the
+/// arena when it outgrows them. Both push_front and push_back are amortized
+/// O(1): the elements sit in the middle of the buffer with spare room on
+/// either side, which suits the right-recursive list rules of the parser.
+template <class T, unsigned N>
+class arenaVector {
+	decafArena &arena;
+	T *buf;
+	size_t cap;
+	T *first;   // elements are [first, last) inside [buf, buf + cap)
+	T *last;
+	T inlineBuf[N];
+
+	// the inline slots make a copy unsafe, lists are passed around by pointer
+	arenaVector(const arenaVector &) = delete;
+	arenaVector &operator=(const arenaVector &) = delete;
+
+	void grow() {
+		size_t n = last - first;
+		size_t newCap = cap * 2 + 2;
+		T *newBuf = (T *)arena.allocate(newCap * sizeof(T));
+		T *newFirst = newBuf + (newCap - n) / 2;
+		copy(first, last, newFirst);
+		buf = newBuf;
+		cap = newCap;
+		first = newFirst;
+		last = newFirst + n;
+	}
+public:
+	// start at the back of the inline slots since the parser mostly prepends
+	arenaVector(decafArena &a) : arena(a), buf(inlineBuf), cap(N), first(inlineBuf + N), last(inlineBuf + N) {}
+
+	void push_front(const T &e) {
+		if (first == buf) { grow(); }
+		*--first = e;
+	}
+	void push_back(const T &e) {
+		if (last == buf + cap) { grow(); }
+		*last++ = e;
+	}
+	size_t size() const { return last - first; }
+	bool empty() const { return first == last; }
+	T &front() { return *first; }
+	T &back() { return *(last - 1); }
+	T &operator[](size_t i) { return first[i]; }
+	T *begin() { return first; }
+	T *end() { return last; }
+	const T *data() const { return first; }
+};
+
+#endif
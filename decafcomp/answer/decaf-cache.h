@@ -0,0 +1,250 @@
+
+#ifndef _DECAF_CACHE
+#define _DECAF_CACHE
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include <algorithm>
+#include <cctype>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace std;
+
+/// compileCache - on-disk cache of compiler outputs (printed IR, .ll/.bc
+/// and native .o/.s files), keyed by the MD5 of the source and of every
+/// option that changes the output. A hit copies the stored file and skips
+/// scanning, parsing and code generation. Entries are files named by
+/// their key; a hit refreshes the entry's mtime and the oldest entries are
+/// removed once the directory grows past maxBytes. Stores go through a
+/// temporary file and rename(), so processes sharing the directory only
+/// ever see complete entries. Hit, miss and eviction counts are kept in
+/// the directory's "stats" file, updated under flock().
+/// Lookups and stores only count; flush(), once per compilation, writes
+/// the counts and scans the directory for eviction when the stores may
+/// have taken it past maxBytes.
+class compileCache {
+	string dir;
+	uint64_t maxBytes;
+	// counts not yet in the stats file
+	uint64_t hits, misses;
+	// size of the directory at the last scan, and of the stores since;
+	// entries other processes add are only seen by the next scan
+	bool scanned;
+	uint64_t scannedBytes;
+	uint64_t storedBytes;
+
+	string entryPath(const string &key) const { return dir + "/" + key; }
+
+	// entries are exactly the 32 hex digit keys, anything else is left alone
+	static bool isEntry(const char *name) {
+		size_t n = 0;
+		for (; name[n] != '\0'; n++) {
+			if (!isxdigit((unsigned char)name[n])) {
+				return false;
+			}
+		}
+		return n == 32;
+	}
+
+	// add to the counters in the stats file
+	void record(uint64_t hits, uint64_t misses, uint64_t evictions) {
+		int fd = open((dir + "/stats").c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0) {
+			return;
+		}
+		flock(fd, LOCK_EX);
+		uint64_t total[3] = { 0, 0, 0 };
+		char buf[128];
+		ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+		if (n > 0) {
+			buf[n] = '\0';
+			sscanf(buf, "%" SCNu64 " %" SCNu64 " %" SCNu64, &total[0], &total[1], &total[2]);
+		}
+		total[0] += hits;
+		total[1] += misses;
+		total[2] += evictions;
+		n = snprintf(buf, sizeof(buf), "%" PRIu64 " %" PRIu64 " %" PRIu64 "\n", total[0], total[1], total[2]);
+		if (ftruncate(fd, 0) == 0) {
+			pwrite(fd, buf, n, 0);
+		}
+		flock(fd, LOCK_UN);
+		close(fd);
+	}
+
+	// write data to a temporary file of its own next to the entry and move
+	// it in place
+	bool install(const string &key, const char *data, size_t size) {
+		int fd;
+		llvm::SmallString<128> tmp;
+		if (llvm::sys::fs::createUniqueFile(dir + "/tmp.%%%%%%%%%%%%", fd, tmp)) {
+			return false;
+		}
+		FILE *f = fdopen(fd, "wb");
+		if (f == NULL) {
+			close(fd);
+			unlink(tmp.c_str());
+			return false;
+		}
+		bool ok = fwrite(data, 1, size, f) == size;
+		ok = fclose(f) == 0 && ok;
+		if (!ok || rename(tmp.c_str(), entryPath(key).c_str()) != 0) {
+			unlink(tmp.c_str());
+			return false;
+		}
+		storedBytes += size;
+		return true;
+	}
+
+	// drop the least recently used entries until the cache fits maxBytes,
+	// returns how many were dropped
+	uint64_t evict() {
+		struct entry {
+			time_t mtime;
+			uint64_t size;
+			string path;
+			bool operator<(const entry &e) const { return mtime < e.mtime; }
+		};
+		DIR *d = opendir(dir.c_str());
+		if (d == NULL) {
+			return 0;
+		}
+		vector<entry> entries;
+		uint64_t total = 0;
+		while (struct dirent *de = readdir(d)) {
+			struct stat st;
+			if (!isEntry(de->d_name) || stat(entryPath(de->d_name).c_str(), &st) != 0) {
+				continue;
+			}
+			entry e = { st.st_mtime, (uint64_t)st.st_size, entryPath(de->d_name) };
+			entries.push_back(e);
+			total += st.st_size;
+		}
+		closedir(d);
+		uint64_t evicted = 0;
+		if (total > maxBytes) {
+			sort(entries.begin(), entries.end());
+			for (size_t i = 0; i < entries.size() && total > maxBytes; i++) {
+				if (unlink(entries[i].path.c_str()) == 0) {
+					total -= entries[i].size;
+					evicted++;
+				}
+			}
+		}
+		scanned = true;
+		scannedBytes = total;
+		return evicted;
+	}
+
+public:
+	compileCache(const string &d, uint64_t max)
+		: dir(d), maxBytes(max), hits(0), misses(0), scanned(false), scannedBytes(0), storedBytes(0) {
+		llvm::sys::fs::create_directories(dir);
+	}
+	~compileCache() { flush(); }
+
+	// the key of source compiled with the options spelled out in flags;
+	// the compiler build, LLVM version and host target are part of it
+	static string key(const string &source, const string &flags) {
+		llvm::MD5 hash;
+		string compiler = string("decafcomp " __DATE__ " " __TIME__ " llvm " LLVM_VERSION_STRING " ")
+			+ llvm::sys::getDefaultTargetTriple() + " " + llvm::sys::getHostCPUName().str();
+		hash.update(compiler);
+		hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *)"", 1));
+		hash.update(flags);
+		hash.update(llvm::ArrayRef<uint8_t>((const uint8_t *)"", 1));
+		hash.update(source);
+		llvm::MD5::MD5Result result;
+		hash.final(result);
+		return result.digest().str().str();
+	}
+
+	// copy the entry for key to os, into data or to the file path; false
+	// on a miss
+	bool fetch(const string &key, ostream &os) {
+		ifstream in(entryPath(key).c_str(), ios::binary);
+		if (!in || !(os << in.rdbuf())) {
+			misses++;
+			return false;
+		}
+		utimes(entryPath(key).c_str(), NULL);
+		hits++;
+		return true;
+	}
+	bool fetch(const string &key, string &data) {
+		ifstream in(entryPath(key).c_str(), ios::binary);
+		if (!in) {
+			misses++;
+			return false;
+		}
+		data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		utimes(entryPath(key).c_str(), NULL);
+		hits++;
+		return true;
+	}
+	bool fetch(const string &key, const string &path) {
+		if (llvm::sys::fs::copy_file(entryPath(key), path)) {
+			misses++;
+			return false;
+		}
+		utimes(entryPath(key).c_str(), NULL);
+		hits++;
+		return true;
+	}
+
+	// add an entry from memory or from a file the compiler wrote; a cache
+	// that cannot be written only costs the hits
+	bool store(const string &key, const string &data) {
+		return install(key, data.data(), data.size());
+	}
+	bool storeFile(const string &key, const string &path) {
+		ifstream in(path.c_str(), ios::binary);
+		string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+		return in.good() || in.eof() ? install(key, data.data(), data.size()) : false;
+	}
+
+	// end of a compilation: evict if the stores may have outgrown the
+	// cache, which takes one directory scan per process at most unless
+	// it does, and add the counts to the stats file
+	void flush() {
+		uint64_t evicted = 0;
+		if (storedBytes > 0) {
+			if (!scanned || scannedBytes + storedBytes > maxBytes) {
+				evicted = evict();
+			} else {
+				scannedBytes += storedBytes;
+			}
+			storedBytes = 0;
+		}
+		if (hits > 0 || misses > 0 || evicted > 0) {
+			record(hits, misses, evicted);
+			hits = misses = 0;
+		}
+	}
+
+	void printStats(ostream &os) {
+		uint64_t total[3] = { 0, 0, 0 };
+		FILE *f = fopen((dir + "/stats").c_str(), "r");
+		if (f != NULL) {
+			fscanf(f, "%" SCNu64 " %" SCNu64 " %" SCNu64, &total[0], &total[1], &total[2]);
+			fclose(f);
+		}
+		os << "cache: " << total[0] << " hits, " << total[1] << " misses, " << total[2] << " evictions in " << dir << endl;
+	}
+};
+
+#endif
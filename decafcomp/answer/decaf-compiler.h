@@ -0,0 +1,147 @@
+
+#ifndef _DECAF_COMPILER
+#define _DECAF_COMPILER
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "decaf-arena.h"
+#include "decaf-cache.h"
+#include "decaf-pipeline.h"
+#include "decaf-symtbl.h"
+#include "decaf-tokens.h"
+#include "decaf-vm.h"
+
+using namespace std;
+
+class decafAST;
+
+/// compilerOptions - what the command line of decafcomp selects.
+struct compilerOptions {
+	// print AST?
+	bool printAST = false;
+	// report arena usage and timings?
+	bool printStats = false;
+	// LLVM optimization level, set with -O0 .. -O3
+	unsigned optLevel = 0;
+	// write native code here instead of printing the IR (-c object, -S assembly)
+	string nativeFile;
+	bool nativeAssembly = false;
+	// write the IR to this file (-o) rather than stderr, as bitcode with --emit=bc
+	string outputFile;
+	bool emitBitcode = false;
+	// --release: drop the names of LLVM values, they only help reading the IR
+	bool releaseMode = false;
+	// --run: JIT the program and run it instead of writing any output
+	bool runProgram = false;
+	// --vm: run the program on the bytecode interpreter, LLVM is not used
+	bool useVM = false;
+	// --tier[=N]: interpret, compiling functions after N calls or loop iterations
+	uint32_t tierThreshold = 0;
+	// check array indexes at runtime, off with --no-bounds-check
+	bool boundsChecks = true;
+	// -j<N>: generate and optimize the method bodies on N threads
+	unsigned codegenJobs = 1;
+	// --cache=DIR (or $DECAF_CACHE_DIR): reuse outputs of earlier
+	// compilations of the same source, keeping at most cacheSize bytes
+	string cacheDir;
+	uint64_t cacheSize = 256 << 20;
+	// --incremental: keep each method's code in the cache and regenerate
+	// only the methods that changed
+	bool incremental = false;
+	// --stream: generate each method as soon as it is parsed and free its
+	// AST, so the AST in memory is one method's rather than the program's
+	bool stream = false;
+	// --pipeline: stream the methods, with scanning, parsing and code
+	// generation each on its own thread
+	bool pipeline = false;
+	// --batch-lex: scan the whole source into a token buffer before the
+	// parse, which then reads the tokens by index
+	bool batchLex = false;
+
+	// are the methods generated and optimized one module each?
+	bool perMethod() const { return codegenJobs > 1 || incremental; }
+	// per-method modules need every method's AST, the VM and printing the
+	// AST need the whole tree
+	bool streamMethods() const { return (stream || pipeline) && !perMethod() && !useVM && !printAST; }
+	bool pipelined() const { return pipeline && streamMethods(); }
+	// --pipeline has its own scanning thread
+	bool batchLexing() const { return batchLex && !pipelined(); }
+};
+
+/// CompilerInstance - one compilation of one Decaf source, from scanning
+/// to the output the options ask for. The instance owns everything the
+/// compilation keeps: the AST arena, the identifiers, the LLVM context
+/// and module, and the scanner and parser state, which are reentrant.
+/// While it runs, the code generator on the calling thread (and the
+/// workers of -j, or the code generation thread of --pipeline) is
+/// pointed at the instance. Separate instances can
+/// compile at the same time on different threads; one instance runs one
+/// compilation at a time.
+class CompilerInstance {
+public:
+	compilerOptions options;
+	// "semantic error" messages go to out, like the program's own output;
+	// syntax errors, statistics and the IR go to err
+	ostream &out;
+	ostream &err;
+
+	decafArena arena;
+	symbolInterner identifiers;
+	// the id of "main", interned first by every compilation
+	int mainId;
+	// with --batch-lex, the tokens of the source being compiled
+	tokenBuffer tokens;
+	vmProgram bytecode;
+	unique_ptr<llvm::LLVMContext> context;
+	unique_ptr<llvm::Module> module;
+	unique_ptr<llvm::IRBuilder<> > builder;
+	// set by the parser when code generation rejects the program
+	bool semanticError;
+	// with --stream, the methods found ahead of the parse, and where the
+	// arena is rolled back to after each method
+	vector<decafAST *> streamPrototypes;
+	decafArena::position streamMark;
+	// with --pipeline, the parser's queue to the code generation thread
+	unique_ptr<codegenPipe> pipe;
+	unique_ptr<compileCache> cache;
+
+	CompilerInstance(const compilerOptions &opts, ostream &o = cout, ostream &e = cerr)
+		: options(opts), out(o), err(e), mainId(-1), semanticError(false) {
+		if (!options.cacheDir.empty()) {
+			cache.reset(new compileCache(options.cacheDir, options.cacheSize));
+		}
+	}
+
+	// compile a file, or stdin if path is empty; returns the exit status
+	// decafcomp would, including the program's own with --run or --vm
+	int compileFile(const string &path);
+	// compile source held in memory
+	int compileString(const string &source);
+	// the options that change the generated code of a method, as they go
+	// into its cache key; a method's bitcode is the same whatever is
+	// written out in the end
+	string codegenFlags() const;
+	// the same with the kind of output, as they go into cache keys
+	string outputFlags() const;
+private:
+	// key of the output being produced, empty when it is not cached
+	string cacheKey;
+
+	bool cacheable() const;
+	int compileCached(const string &source);
+	int compileBytes(const string &source);
+	int compile(void *scanner, const string *source);
+	void predeclare(const string &source);
+	int parsePipelined(const string &source);
+	int parseBuffered(const string &source);
+	int finish(int retval);
+};
+
+#endif
@@ -0,0 +1,56 @@
+
+#ifndef _DECAF_EMIT
+#define _DECAF_EMIT
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "decaf-opt.h"
+
+using namespace std;
+
+/// emitNative - compile the module for the host in-process and write an
+/// object file, or assembly if requested, to path. This replaces the
+/// print IR / llvm-as / llc round trip through text files.
+inline void emitNative(llvm::Module *M, const string &path, bool assembly, unsigned optLevel) {
+	unique_ptr<llvm::TargetMachine> TM = hostTargetMachine(optLevel);
+	M->setTargetTriple(TM->getTargetTriple().str());
+	M->setDataLayout(TM->createDataLayout());
+
+	std::error_code ec;
+	llvm::raw_fd_ostream dest(path, ec, llvm::sys::fs::F_None);
+	if (ec) {
+		throw runtime_error("cannot open " + path + ": " + ec.message());
+	}
+	llvm::legacy::PassManager PM;
+	llvm::TargetMachine::CodeGenFileType fileType = assembly ? llvm::TargetMachine::CGFT_AssemblyFile : llvm::TargetMachine::CGFT_ObjectFile;
+	if (TM->addPassesToEmitFile(PM, dest, nullptr, fileType)) {
+		throw runtime_error("target cannot emit this file type");
+	}
+	PM.run(*M);
+	dest.flush();
+}
+
+/// emitModule - write the module as textual IR or as bitcode to path
+/// ("-" is stdout) through one buffered stream.
+inline void emitModule(llvm::Module *M, const string &path, bool bitcode) {
+	std::error_code ec;
+	llvm::raw_fd_ostream dest(path, ec, bitcode ? llvm::sys::fs::F_None : llvm::sys::fs::F_Text);
+	if (ec) {
+		throw runtime_error("cannot open " + path + ": " + ec.message());
+	}
+	if (bitcode) {
+		llvm::WriteBitcodeToFile(*M, dest);
+	} else {
+		M->print(dest, nullptr);
+	}
+	dest.flush();
+}
+
+#endif
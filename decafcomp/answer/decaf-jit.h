@@ -0,0 +1,58 @@
+
+#ifndef _DECAF_JIT
+#define _DECAF_JIT
+
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include <cstdio>
+#include <memory>
+#include "decaf-opt.h"
+
+using namespace std;
+
+// the runtime from decaf-stdlib.c, linked into the compiler itself
+extern "C" {
+	void print_int(int x);
+	void print_string(const char *s);
+	int read_int();
+	void decaf_bounds_error(int index, int size);
+}
+
+/// runJIT - compile the module with ORC in this process and call its main.
+/// The module and its context are handed over to the JIT. Calls to the
+/// runtime resolve to the copies linked into the compiler, so no object
+/// file, assembler or linker is involved. Returns the program's exit code.
+inline int runJIT(unique_ptr<llvm::Module> M, unique_ptr<llvm::LLVMContext> Ctx) {
+	initializeHostTarget();
+	llvm::ExitOnError check("error: jit: ");
+
+	llvm::orc::JITTargetMachineBuilder JTMB = check(llvm::orc::JITTargetMachineBuilder::detectHost());
+	llvm::DataLayout DL = check(JTMB.getDefaultDataLayoutForTarget());
+	unique_ptr<llvm::orc::LLJIT> J = check(llvm::orc::LLJIT::Create(std::move(JTMB), DL));
+	M->setDataLayout(DL);
+
+	llvm::orc::MangleAndInterner mangle(J->getExecutionSession(), DL);
+	llvm::orc::SymbolMap runtime;
+	runtime[mangle("print_int")] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&print_int), llvm::JITSymbolFlags::Exported);
+	runtime[mangle("print_string")] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&print_string), llvm::JITSymbolFlags::Exported);
+	runtime[mangle("read_int")] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&read_int), llvm::JITSymbolFlags::Exported);
+	runtime[mangle("decaf_bounds_error")] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(&decaf_bounds_error), llvm::JITSymbolFlags::Exported);
+	check(J->getMainJITDylib().define(llvm::orc::absoluteSymbols(runtime)));
+
+	check(J->addIRModule(llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx))));
+	llvm::JITEvaluatedSymbol mainSym = check(J->lookup("main"));
+	int (*mainFn)() = (int (*)())mainSym.getAddress();
+	int ret = mainFn();
+	fflush(stdout);
+	return ret;
+}
+
+#endif
@@ -0,0 +1,103 @@
+
+#ifndef _DECAF_OPT
+#define _DECAF_OPT
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+/// initializeHostTarget - register the host target with LLVM. The
+/// registry is process-wide, so this is the only place that fills it:
+/// once, whichever thread or compilation gets here first.
+inline void initializeHostTarget() {
+	static once_flag initialized;
+	call_once(initialized, []() {
+		llvm::InitializeNativeTarget();
+		llvm::InitializeNativeTargetAsmPrinter();
+	});
+}
+
+/// hostTargetMachine - a TargetMachine for the CPU the compiler runs on.
+inline unique_ptr<llvm::TargetMachine> hostTargetMachine(unsigned optLevel) {
+	initializeHostTarget();
+	string triple = llvm::sys::getDefaultTargetTriple();
+	string err;
+	const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, err);
+	if (target == NULL) {
+		throw runtime_error("no target for " + triple + ": " + err);
+	}
+	llvm::CodeGenOpt::Level cgLevel = optLevel == 0 ? llvm::CodeGenOpt::None
+		: optLevel == 1 ? llvm::CodeGenOpt::Less
+		: optLevel == 2 ? llvm::CodeGenOpt::Default : llvm::CodeGenOpt::Aggressive;
+	llvm::TargetOptions options;
+	return unique_ptr<llvm::TargetMachine>(target->createTargetMachine(triple,
+		llvm::sys::getHostCPUName(), "", options, llvm::Reloc::PIC_,
+		llvm::Optional<llvm::CodeModel::Model>(), cgLevel));
+}
+
+/// optimizeModule - run the standard LLVM pipeline for -O<level> over the
+/// module. Level 1 already promotes the allocas of locals to registers
+/// (SROA/mem2reg) and runs instcombine, simplifycfg and early CSE;
+/// level 2 adds GVN, the loop passes and inlining, level 3 is the
+/// aggressive variant. Level 0 leaves the module untouched.
+/// The passes see the host's cost model, without it the loop
+/// vectorizer assumes there are no vector registers.
+inline void optimizeModule(llvm::Module *M, unsigned level) {
+	if (level == 0) {
+		return;
+	}
+	// the passes assume well-formed IR, catch codegen bugs here instead
+	if (llvm::verifyModule(*M, &llvm::errs())) {
+		throw runtime_error("generated module is not valid");
+	}
+	unique_ptr<llvm::TargetMachine> TM = hostTargetMachine(level);
+	if (M->getTargetTriple().empty()) {
+		M->setTargetTriple(TM->getTargetTriple().str());
+		M->setDataLayout(TM->createDataLayout());
+	}
+	llvm::PassManagerBuilder PMB;
+	PMB.OptLevel = level;
+	PMB.SizeLevel = 0;
+	if (level > 1) {
+		PMB.Inliner = llvm::createFunctionInliningPass(level, 0, false);
+		PMB.LoopVectorize = true;
+		PMB.SLPVectorize = true;
+	} else {
+		PMB.Inliner = llvm::createAlwaysInlinerLegacyPass();
+	}
+
+	TM->adjustPassManager(PMB);
+
+	llvm::legacy::FunctionPassManager FPM(M);
+	FPM.add(llvm::createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+	PMB.populateFunctionPassManager(FPM);
+	FPM.doInitialization();
+	for (llvm::Function &F : *M) {
+		FPM.run(F);
+	}
+	FPM.doFinalization();
+
+	llvm::legacy::PassManager MPM;
+	MPM.add(llvm::createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+	PMB.populateModulePassManager(MPM);
+	MPM.run(*M);
+}
+
+#endif
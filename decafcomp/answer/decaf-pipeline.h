@@ -0,0 +1,78 @@
+
+#ifndef _DECAF_PIPELINE
+#define _DECAF_PIPELINE
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+/// spscRing - fixed-size lock-free queue from one producer thread to one
+/// consumer thread. Each side owns one index and only reads the other's;
+/// the release store of an index publishes the slots before it. A full
+/// or empty ring is waited out by yielding, which is fine between stages
+/// that run at roughly the same rate. cancel() releases a waiting side
+/// when the other one gives up early, e.g. the parser on a syntax error.
+template <class T, size_t N>
+class spscRing {
+	T slots[N];
+	atomic<size_t> head;   // next slot to pop, written by the consumer
+	atomic<size_t> tail;   // next slot to push, written by the producer
+	atomic<bool> cancelled;
+public:
+	spscRing() : head(0), tail(0), cancelled(false) {}
+
+	// false if the ring was cancelled
+	bool push(const T &v) {
+		size_t t = tail.load(memory_order_relaxed);
+		while (t - head.load(memory_order_acquire) == N) {
+			if (cancelled.load(memory_order_relaxed)) {
+				return false;
+			}
+			this_thread::yield();
+		}
+		slots[t % N] = v;
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+	bool pop(T &v) {
+		size_t h = head.load(memory_order_relaxed);
+		while (tail.load(memory_order_acquire) == h) {
+			if (cancelled.load(memory_order_relaxed)) {
+				return false;
+			}
+			this_thread::yield();
+		}
+		v = slots[h % N];
+		head.store(h + 1, memory_order_release);
+		return true;
+	}
+	void cancel() { cancelled.store(true, memory_order_relaxed); }
+};
+
+class decafAST;
+
+/// codegenItem - one step for the code generation thread of --pipeline:
+/// generate node, or only declare it (a method's prototype). A NULL node
+/// ends the stream.
+struct codegenItem {
+	decafAST *node;
+	bool declare;
+};
+
+/// codegenPipe - what the parser hands to the code generation thread, in
+/// source order. The first semantic error stops code generation; the
+/// parser checks failed to stop early and reads error after joining
+/// worker.
+struct codegenPipe {
+	spscRing<codegenItem, 1024> items;
+	atomic<bool> failed;
+	string error;
+	thread worker;
+
+	codegenPipe() : failed(false) {}
+};
+
+#endif
@@ -0,0 +1,156 @@
+
+#ifndef _DECAF_SSA
+#define _DECAF_SSA
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/// ssaVariable - a local variable or parameter. It has no storage, only
+/// a current value in each block.
+struct ssaVariable {
+	llvm::Type *type;
+	string name;
+};
+
+/// ssaBuilder - builds SSA form while the IR is generated, following
+/// Braun et al., "Simple and Efficient Construction of Static Single
+/// Assignment Form" (CC 2013). Assignments record the value of the
+/// variable in the current block, reads look it up and walk back
+/// through the predecessors, adding phis where paths join. A block is
+/// sealed once all its predecessors are known; until then reads in it
+/// get placeholder phis that are completed when it is sealed. Phis
+/// that turn out to merge a single value are removed as they appear.
+class ssaBuilder {
+	typedef llvm::DenseMap<ssaVariable *, llvm::WeakTrackingVH> blockDefs;
+	llvm::DenseMap<llvm::BasicBlock *, blockDefs> defs;
+	llvm::DenseMap<llvm::BasicBlock *, vector<pair<ssaVariable *, llvm::PHINode *> > > incomplete;
+	llvm::SmallPtrSet<llvm::BasicBlock *, 32> sealed;
+	llvm::SmallPtrSet<llvm::PHINode *, 8> filling;   // operands still being added
+	deque<ssaVariable> variables;
+
+	llvm::PHINode *newPhi(ssaVariable *v, llvm::BasicBlock *bb) {
+		if (bb->empty()) {
+			return llvm::PHINode::Create(v->type, 0, v->name, bb);
+		}
+		return llvm::PHINode::Create(v->type, 0, v->name, &bb->front());
+	}
+
+	llvm::Value *readRecursive(ssaVariable *v, llvm::BasicBlock *bb) {
+		llvm::Value *val;
+		if (!sealed.count(bb)) {
+			llvm::PHINode *phi = newPhi(v, bb);
+			incomplete[bb].push_back(make_pair(v, phi));
+			val = phi;
+		} else if (llvm::BasicBlock *pred = bb->getSinglePredecessor()) {
+			val = read(v, pred);
+		} else if (llvm::pred_begin(bb) == llvm::pred_end(bb)) {
+			// unreachable code, e.g. after a return
+			val = llvm::UndefValue::get(v->type);
+		} else {
+			// break cycles through loops with the phi itself
+			llvm::PHINode *phi = newPhi(v, bb);
+			write(v, bb, phi);
+			val = addPhiOperands(v, phi);
+		}
+		write(v, bb, val);
+		return val;
+	}
+
+	llvm::Value *addPhiOperands(ssaVariable *v, llvm::PHINode *phi) {
+		llvm::BasicBlock *bb = phi->getParent();
+		filling.insert(phi);
+		for (llvm::pred_iterator i = llvm::pred_begin(bb); i != llvm::pred_end(bb); ++i) {
+			phi->addIncoming(read(v, *i), *i);
+		}
+		filling.erase(phi);
+		return removeTrivialPhi(phi);
+	}
+
+	// a phi whose operands are all one value (or the phi) is that value
+	llvm::Value *removeTrivialPhi(llvm::PHINode *phi) {
+		llvm::Value *same = NULL;
+		for (unsigned i = 0; i < phi->getNumIncomingValues(); i++) {
+			llvm::Value *op = phi->getIncomingValue(i);
+			if (op == same || op == phi) {
+				continue;
+			}
+			if (same != NULL) {
+				return phi;
+			}
+			same = op;
+		}
+		if (same == NULL) {
+			same = llvm::UndefValue::get(phi->getType());
+		}
+		// phis using this one may become trivial in turn; the handles
+		// drop the ones removed meanwhile
+		vector<llvm::WeakVH> users;
+		for (llvm::User *u : phi->users()) {
+			if (u != phi && llvm::isa<llvm::PHINode>(u)) {
+				users.push_back(llvm::WeakVH(u));
+			}
+		}
+		// the handles in defs follow the replacement, and so does the
+		// result, which may itself be one of the phis removed below
+		llvm::WeakTrackingVH result(same);
+		phi->replaceAllUsesWith(same);
+		phi->eraseFromParent();
+		for (size_t i = 0; i < users.size(); i++) {
+			llvm::PHINode *p = llvm::dyn_cast_or_null<llvm::PHINode>(users[i]);
+			// a phi that is still being filled is checked once it is complete
+			if (p != NULL && !filling.count(p)) {
+				removeTrivialPhi(p);
+			}
+		}
+		return result;
+	}
+
+public:
+	// forget the blocks and variables of the previous function; the
+	// builder is per thread and outlives compilations
+	void startFunction() {
+		defs.clear();
+		incomplete.clear();
+		sealed.clear();
+		variables.clear();
+	}
+	ssaVariable *declare(llvm::Type *type, const string &name) {
+		ssaVariable v = { type, name };
+		variables.push_back(v);
+		return &variables.back();
+	}
+
+	void write(ssaVariable *v, llvm::BasicBlock *bb, llvm::Value *val) {
+		defs[bb][v] = val;
+	}
+	llvm::Value *read(ssaVariable *v, llvm::BasicBlock *bb) {
+		blockDefs::iterator i = defs[bb].find(v);
+		if (i != defs[bb].end()) {
+			return i->second;
+		}
+		return readRecursive(v, bb);
+	}
+
+	// all predecessors of bb have their branches now
+	void seal(llvm::BasicBlock *bb) {
+		vector<pair<ssaVariable *, llvm::PHINode *> > phis;
+		phis.swap(incomplete[bb]);
+		sealed.insert(bb);
+		for (size_t i = 0; i < phis.size(); i++) {
+			addPhiOperands(phis[i].first, phis[i].second);
+		}
+	}
+};
+
+#endif
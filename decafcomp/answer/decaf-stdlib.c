@@ -1,6 +1,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 
 void print_int(int x) {
   printf("%d", x);
@@ -16,3 +17,10 @@ int read_int() {
   return i;
 }
 
+
+/* called by bounds-checked array accesses, never returns */
+void decaf_bounds_error(int index, int size) {
+  fflush(stdout);
+  fprintf(stderr, "runtime error: array index %d out of bounds for size %d\n", index, size);
+  exit(1);
+}
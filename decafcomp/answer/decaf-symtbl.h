@@ -0,0 +1,139 @@
+
+#ifndef _DECAF_SYMTBL
+#define _DECAF_SYMTBL
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+/// symbolInterner - maps each distinct identifier to a dense integer id.
+/// Flat open-addressing table (linear probing) over the id array, so a
+/// lookup is one hash of the name and usually a single probe. Names are
+/// kept in fixed-size blocks that never move: one thread may intern while
+/// others read the names of ids that were handed to them, e.g. the lexer
+/// and code generation threads of --pipeline.
+class symbolInterner {
+	static const int blockBits = 12;
+	static const int blockSize = 1 << blockBits;
+	static const int maxBlocks = 1 << 12;
+	unique_ptr<string[]> blocks[maxBlocks];   // id -> identifier
+	atomic<int> count;
+	vector<int> slots;      // hash slot -> id, -1 if empty
+	vector<uint32_t> hashes; // id -> full hash, avoids rehashing on grow
+
+	static uint32_t hash(const char *s, size_t len) {
+		uint32_t h = 2166136261u; // FNV-1a
+		for (size_t i = 0; i < len; i++) {
+			h ^= (unsigned char)s[i];
+			h *= 16777619u;
+		}
+		return h;
+	}
+	string &at(int id) const { return blocks[id >> blockBits][id & (blockSize - 1)]; }
+	void grow() {
+		vector<int> old(slots.size() * 2, -1);
+		slots.swap(old);
+		size_t mask = slots.size() - 1;
+		for (size_t id = 0; id < hashes.size(); id++) {
+			size_t i = hashes[id] & mask;
+			while (slots[i] != -1) { i = (i + 1) & mask; }
+			slots[i] = id;
+		}
+	}
+public:
+	symbolInterner() : count(0), slots(64, -1) {}
+	int intern(const char *s, size_t len) {
+		uint32_t h = hash(s, len);
+		size_t mask = slots.size() - 1;
+		size_t i = h & mask;
+		while (slots[i] != -1) {
+			int id = slots[i];
+			if (hashes[id] == h && at(id).size() == len && at(id).compare(0, len, s, len) == 0) {
+				return id;
+			}
+			i = (i + 1) & mask;
+		}
+		int id = hashes.size();
+		if (id >> blockBits >= maxBlocks) {
+			throw runtime_error("too many identifiers");
+		}
+		if (!blocks[id >> blockBits]) {
+			blocks[id >> blockBits].reset(new string[blockSize]);
+		}
+		at(id).assign(s, len);
+		hashes.push_back(h);
+		slots[i] = id;
+		count.store(id + 1, memory_order_release);
+		if (hashes.size() * 2 > slots.size()) { grow(); }
+		return id;
+	}
+	int intern(const string &s) { return intern(s.data(), s.size()); }
+	const string &name(int id) const { return at(id); }
+	int size() const { return count.load(memory_order_acquire); }
+	// the blocks are kept for the next compilation
+	void clear() {
+		count.store(0, memory_order_relaxed);
+		hashes.clear();
+		slots.assign(64, -1);
+	}
+};
+
+/// scopedSymbolTable - symbol table for nested scopes.
+/// Every interned id owns one slot holding its innermost binding, so a
+/// lookup is a single array index no matter how deep the scopes are.
+/// Shadowed bindings are saved in an undo log and restored on pop_scope.
+template <class V>
+class scopedSymbolTable {
+	struct undoEntry {
+		int id;
+		V *prev;
+	};
+	symbolInterner *ids;
+	vector<V *> bindings;     // id -> innermost binding, NULL if unbound
+	vector<undoEntry> undo;   // shadowed bindings, newest last
+	vector<size_t> marks;     // undo log size at each push_scope
+public:
+	scopedSymbolTable() : ids(NULL) {}
+	scopedSymbolTable(symbolInterner &interner) : ids(&interner) {}
+	// drop every binding and scope, and use the identifiers of interner
+	void reset(symbolInterner &interner) {
+		ids = &interner;
+		bindings.clear();
+		undo.clear();
+		marks.clear();
+	}
+	void push_scope() { marks.push_back(undo.size()); }
+	void pop_scope() {
+		if (marks.empty()) {
+			throw runtime_error("symbol table scope underflow");
+		}
+		size_t mark = marks.back();
+		marks.pop_back();
+		while (undo.size() > mark) {
+			bindings[undo.back().id] = undo.back().prev;
+			undo.pop_back();
+		}
+	}
+	int depth() { return marks.size(); }
+	void insert(int id, V *val) {
+		if (id >= (int)bindings.size()) {
+			bindings.resize(ids->size(), NULL);
+		}
+		undoEntry e = { id, bindings[id] };
+		undo.push_back(e);
+		bindings[id] = val;
+	}
+	V *find(int id) {
+		if (id >= (int)bindings.size()) {
+			return NULL;
+		}
+		return bindings[id];
+	}
+};
+
+#endif
@@ -0,0 +1,325 @@
+
+#ifndef _DECAF_TIER
+#define _DECAF_TIER
+
+#include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "decaf-opt.h"
+#include "decaf-vm.h"
+
+using namespace std;
+
+// Entry points from tiered code back into the runtime. Their addresses
+// are baked into the generated IR, so no symbol resolution is involved.
+// Errors cannot unwind through JIT frames, they end the program here
+// with the message the interpreter would have given.
+static void vmTierTrap(const char *msg) {
+	fflush(stdout);
+	cerr << "runtime error: " << msg << endl;
+	exit(EXIT_FAILURE);
+}
+static int32_t vmTierCall(vmMachine *m, int32_t fnIndex, int32_t *args) {
+	try {
+		return m->call(fnIndex, args);
+	}
+	catch (std::runtime_error &e) {
+		vmTierTrap(e.what());
+	}
+	return 0;
+}
+static void vmTierPrintInt(int32_t i) { printf("%d", i); }
+static void vmTierPrintString(vmMachine *m, int32_t s) { printf("%s", m->prog.strings[s].c_str()); }
+static int32_t vmTierReadInt() {
+	int i = 0;
+	if (scanf("%d", &i) != 1) {
+		i = 0;
+	}
+	return i;
+}
+
+/// vmTierJIT - the second tier of --tier. It translates the bytecode of
+/// a hot function to LLVM IR, optimizes it at -O2 and compiles it with
+/// ORC, then installs it in the machine's native table so that every
+/// later call, from either tier, runs the native version. The JIT is
+/// only created once the first function gets hot, so short programs
+/// never pay for starting LLVM.
+class vmTierJIT {
+	vmMachine &m;
+	unique_ptr<llvm::orc::LLJIT> J;
+	bool printStats;
+	double compileMs;
+	int compiled;
+
+	llvm::Constant *address(llvm::LLVMContext &C, const void *p, llvm::Type *ty) {
+		llvm::Constant *i = llvm::ConstantInt::get(llvm::Type::getInt64Ty(C), (uint64_t)(uintptr_t)p);
+		return llvm::ConstantExpr::getIntToPtr(i, ty);
+	}
+	void translate(const vmFunction &fn, llvm::Module *M);
+public:
+	vmTierJIT(vmMachine &machine, bool stats) : m(machine), printStats(stats), compileMs(0), compiled(0) {}
+	~vmTierJIT() {
+		if (printStats && compiled > 0) {
+			cerr << "tier: " << compiled << " functions compiled in " << compileMs << " ms" << endl;
+		}
+	}
+
+	static void tierUp(vmMachine &machine, int fnIndex, void *data) {
+		((vmTierJIT *)data)->compile(fnIndex);
+	}
+
+	void compile(int fnIndex) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		llvm::ExitOnError check("error: jit: ");
+		if (!J) {
+			initializeHostTarget();
+			llvm::orc::JITTargetMachineBuilder JTMB = check(llvm::orc::JITTargetMachineBuilder::detectHost());
+			llvm::DataLayout DL = check(JTMB.getDefaultDataLayoutForTarget());
+			J = check(llvm::orc::LLJIT::Create(std::move(JTMB), DL));
+		}
+		const vmFunction &fn = m.prog.functions[fnIndex];
+		unique_ptr<llvm::LLVMContext> Ctx(new llvm::LLVMContext);
+		unique_ptr<llvm::Module> M(new llvm::Module("tier." + fn.name, *Ctx));
+		M->setDataLayout(J->getDataLayout());
+		translate(fn, M.get());
+		optimizeModule(M.get(), 2);
+		check(J->addIRModule(llvm::orc::ThreadSafeModule(std::move(M), std::move(Ctx))));
+		llvm::JITEvaluatedSymbol sym = check(J->lookup("tier." + fn.name));
+		m.native[fnIndex] = (vmNativeFn)sym.getAddress();
+		compiled++;
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		compileMs += elapsed.count();
+	}
+};
+
+/// translate - emit fn as i32 @tier.<name>(i32* regs, i32 entry) into M.
+/// Every register becomes an alloca that mem2reg turns back into SSA
+/// values, and every jump target starts a basic block.
+inline void vmTierJIT::translate(const vmFunction &fn, llvm::Module *M) {
+	llvm::LLVMContext &C = M->getContext();
+	llvm::IRBuilder<> B(C);
+	llvm::Type *i32 = llvm::Type::getInt32Ty(C);
+	llvm::Type *i64 = llvm::Type::getInt64Ty(C);
+	llvm::PointerType *i32p = i32->getPointerTo();
+	llvm::PointerType *voidp = llvm::Type::getInt8PtrTy(C);
+	llvm::FunctionType *nativeT = llvm::FunctionType::get(i32, { i32p, i32 }, false);
+	llvm::PointerType *nativeP = nativeT->getPointerTo();
+	llvm::FunctionType *callT = llvm::FunctionType::get(i32, { voidp, i32, i32p }, false);
+	llvm::FunctionType *trapT = llvm::FunctionType::get(B.getVoidTy(), { voidp }, false);
+	llvm::FunctionType *printIntT = llvm::FunctionType::get(B.getVoidTy(), { i32 }, false);
+	llvm::FunctionType *printStringT = llvm::FunctionType::get(B.getVoidTy(), { voidp, i32 }, false);
+	llvm::FunctionType *readIntT = llvm::FunctionType::get(i32, false);
+	llvm::Constant *machine = address(C, &m, voidp);
+	llvm::Constant *g = address(C, m.globals.data(), i32p);
+	llvm::Constant *table = address(C, m.native.data(), nativeP->getPointerTo());
+
+	llvm::Function *F = llvm::Function::Create(nativeT, llvm::Function::ExternalLinkage, "tier." + fn.name, M);
+	llvm::Value *args = &*F->arg_begin();
+	llvm::Value *entryPc = &*(F->arg_begin() + 1);
+	llvm::BasicBlock *entry = llvm::BasicBlock::Create(C, "entry", F);
+	B.SetInsertPoint(entry);
+	vector<llvm::Value *> regs(fn.nregs);
+	for (int i = 0; i < fn.nregs; i++) {
+		regs[i] = B.CreateAlloca(i32);
+	}
+	// room for the outgoing arguments of the widest call
+	int maxArgs = 1;
+	for (size_t pc = 0; pc < fn.code.size(); pc++) {
+		if (fn.code[pc].op == VM_CALL && m.prog.functions[fn.code[pc].b].nparams > maxArgs) {
+			maxArgs = m.prog.functions[fn.code[pc].b].nparams;
+		}
+	}
+	llvm::Value *outArgs = B.CreateAlloca(i32, B.getInt32(maxArgs));
+
+	// a block starts at every jump target and after every jump or return
+	map<int, llvm::BasicBlock *> blocks;
+	blocks[0] = NULL;
+	vector<int> loopHeads;
+	for (size_t pc = 0; pc < fn.code.size(); pc++) {
+		const vmInsn &in = fn.code[pc];
+		if (in.op == VM_JMP) {
+			blocks[in.a] = NULL;
+			if (in.a <= (int)pc) {
+				loopHeads.push_back(in.a);
+			}
+		} else if (in.op == VM_JZ || in.op == VM_JNZ) {
+			blocks[in.b] = NULL;
+		}
+		if (in.op == VM_JMP || in.op == VM_JZ || in.op == VM_JNZ || in.op == VM_RET) {
+			blocks[pc + 1] = NULL;
+		}
+	}
+	for (map<int, llvm::BasicBlock *>::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+		it->second = llvm::BasicBlock::Create(C, "", F);
+	}
+
+	// a call copies in the arguments, on-stack replacement the whole
+	// frame and then jumps to the loop head it was entered at
+	llvm::BasicBlock *call = llvm::BasicBlock::Create(C, "call", F);
+	llvm::SwitchInst *entries = B.CreateSwitch(entryPc, call, loopHeads.size());
+	B.SetInsertPoint(call);
+	for (int i = 0; i < fn.nparams; i++) {
+		B.CreateStore(B.CreateLoad(i32, B.CreateGEP(i32, args, B.getInt32(i))), regs[i]);
+	}
+	B.CreateBr(blocks[0]);
+	for (size_t i = 0; i < loopHeads.size(); i++) {
+		if (entries->findCaseValue(B.getInt32(loopHeads[i])) != entries->case_default()) {
+			continue;
+		}
+		llvm::BasicBlock *osr = llvm::BasicBlock::Create(C, "osr", F);
+		entries->addCase(B.getInt32(loopHeads[i]), osr);
+		B.SetInsertPoint(osr);
+		for (int r = 0; r < fn.nregs; r++) {
+			B.CreateStore(B.CreateLoad(i32, B.CreateGEP(i32, args, B.getInt32(r))), regs[r]);
+		}
+		B.CreateBr(blocks[loopHeads[i]]);
+	}
+
+	// a failed check branches to a block that ends the program
+	auto check = [&](llvm::Value *ok, const char *msg) {
+		llvm::BasicBlock *fail = llvm::BasicBlock::Create(C, "", F);
+		llvm::BasicBlock *cont = llvm::BasicBlock::Create(C, "", F);
+		B.CreateCondBr(ok, cont, fail);
+		B.SetInsertPoint(fail);
+		B.CreateCall(trapT, address(C, (void *)&vmTierTrap, trapT->getPointerTo()), { address(C, msg, voidp) });
+		B.CreateUnreachable();
+		B.SetInsertPoint(cont);
+	};
+	auto reg = [&](int r) { return B.CreateLoad(i32, regs[r]); };
+	auto set = [&](int r, llvm::Value *v) { B.CreateStore(v, regs[r]); };
+	auto element = [&](const vmInsn &in) {
+		const vmArray &arr = m.prog.arrays[in.b];
+		llvm::Value *i = reg(in.c);
+		check(B.CreateICmpULT(i, B.getInt32(arr.size)), "array index out of bounds");
+		return B.CreateGEP(i32, g, B.CreateAdd(B.CreateZExt(i, i64), B.getInt64(arr.base)));
+	};
+
+	for (size_t pc = 0; pc < fn.code.size(); pc++) {
+		map<int, llvm::BasicBlock *>::iterator start = blocks.find(pc);
+		if (start != blocks.end()) {
+			if (pc > 0 && B.GetInsertBlock()->getTerminator() == NULL) {
+				B.CreateBr(start->second);
+			}
+			B.SetInsertPoint(start->second);
+		}
+		const vmInsn &in = fn.code[pc];
+		switch (in.op) {
+		case VM_CONST: set(in.a, B.getInt32(in.b)); break;
+		case VM_MOV: set(in.a, reg(in.b)); break;
+		case VM_LOADG: set(in.a, B.CreateLoad(i32, B.CreateGEP(i32, g, B.getInt64(in.b)))); break;
+		case VM_STOREG: B.CreateStore(reg(in.a), B.CreateGEP(i32, g, B.getInt64(in.b))); break;
+		case VM_LOADA: {
+			llvm::Value *p = element(in);
+			set(in.a, B.CreateLoad(i32, p));
+			break;
+		}
+		case VM_STOREA: {
+			llvm::Value *p = element(in);
+			B.CreateStore(reg(in.a), p);
+			break;
+		}
+		case VM_ADD: set(in.a, B.CreateAdd(reg(in.b), reg(in.c))); break;
+		case VM_SUB: set(in.a, B.CreateSub(reg(in.b), reg(in.c))); break;
+		case VM_MUL: set(in.a, B.CreateMul(reg(in.b), reg(in.c))); break;
+		case VM_DIV:
+		case VM_MOD: {
+			llvm::Value *l = reg(in.b);
+			llvm::Value *r = reg(in.c);
+			check(B.CreateICmpNE(r, B.getInt32(0)), "division by zero");
+			// x / -1 wraps like the interpreter instead of trapping
+			llvm::Value *minusOne = B.CreateICmpEQ(r, B.getInt32(-1));
+			llvm::Value *d = B.CreateSelect(minusOne, B.getInt32(1), r);
+			if (in.op == VM_DIV) {
+				set(in.a, B.CreateSelect(minusOne, B.CreateNeg(l), B.CreateSDiv(l, d)));
+			} else {
+				set(in.a, B.CreateSRem(l, d));
+			}
+			break;
+		}
+		case VM_SHL: set(in.a, B.CreateShl(reg(in.b), B.CreateAnd(reg(in.c), B.getInt32(31)))); break;
+		case VM_SHR: set(in.a, B.CreateLShr(reg(in.b), B.CreateAnd(reg(in.c), B.getInt32(31)))); break;
+		case VM_LT: set(in.a, B.CreateZExt(B.CreateICmpSLT(reg(in.b), reg(in.c)), i32)); break;
+		case VM_LEQ: set(in.a, B.CreateZExt(B.CreateICmpSLE(reg(in.b), reg(in.c)), i32)); break;
+		case VM_GT: set(in.a, B.CreateZExt(B.CreateICmpSGT(reg(in.b), reg(in.c)), i32)); break;
+		case VM_GEQ: set(in.a, B.CreateZExt(B.CreateICmpSGE(reg(in.b), reg(in.c)), i32)); break;
+		case VM_EQ: set(in.a, B.CreateZExt(B.CreateICmpEQ(reg(in.b), reg(in.c)), i32)); break;
+		case VM_NEQ: set(in.a, B.CreateZExt(B.CreateICmpNE(reg(in.b), reg(in.c)), i32)); break;
+		case VM_AND: set(in.a, B.CreateAnd(reg(in.b), reg(in.c))); break;
+		case VM_OR: set(in.a, B.CreateOr(reg(in.b), reg(in.c))); break;
+		case VM_NEG: set(in.a, B.CreateNeg(reg(in.b))); break;
+		case VM_NOT: set(in.a, B.CreateZExt(B.CreateICmpEQ(reg(in.b), B.getInt32(0)), i32)); break;
+		case VM_JMP: B.CreateBr(blocks[in.a]); break;
+		case VM_JZ: B.CreateCondBr(B.CreateICmpNE(reg(in.a), B.getInt32(0)), blocks[pc + 1], blocks[in.b]); break;
+		case VM_JNZ: B.CreateCondBr(B.CreateICmpNE(reg(in.a), B.getInt32(0)), blocks[in.b], blocks[pc + 1]); break;
+		case VM_CALL: {
+			for (int i = 0; i < m.prog.functions[in.b].nparams; i++) {
+				B.CreateStore(reg(in.c + i), B.CreateGEP(i32, outArgs, B.getInt32(i)));
+			}
+			// go straight to the callee once it is native, else back to the interpreter
+			llvm::Value *target = B.CreateLoad(nativeP, B.CreateGEP(nativeP, table, B.getInt64(in.b)));
+			llvm::BasicBlock *direct = llvm::BasicBlock::Create(C, "", F);
+			llvm::BasicBlock *interp = llvm::BasicBlock::Create(C, "", F);
+			llvm::BasicBlock *done = llvm::BasicBlock::Create(C, "", F);
+			B.CreateCondBr(B.CreateIsNotNull(target), direct, interp);
+			B.SetInsertPoint(direct);
+			set(in.a, B.CreateCall(nativeT, target, { outArgs, B.getInt32(0) }));
+			B.CreateBr(done);
+			B.SetInsertPoint(interp);
+			set(in.a, B.CreateCall(callT, address(C, (void *)&vmTierCall, callT->getPointerTo()),
+				{ machine, B.getInt32(in.b), outArgs }));
+			B.CreateBr(done);
+			B.SetInsertPoint(done);
+			break;
+		}
+		case VM_RET: B.CreateRet(in.a < 0 ? (llvm::Value *)B.getInt32(0) : reg(in.a)); break;
+		case VM_PRINTI:
+			B.CreateCall(printIntT, address(C, (void *)&vmTierPrintInt, printIntT->getPointerTo()), { reg(in.a) });
+			break;
+		case VM_PRINTS:
+			B.CreateCall(printStringT, address(C, (void *)&vmTierPrintString, printStringT->getPointerTo()),
+				{ machine, reg(in.a) });
+			break;
+		case VM_READI:
+			set(in.a, B.CreateCall(readIntT, address(C, (void *)&vmTierReadInt, readIntT->getPointerTo())));
+			break;
+		default:
+			throw runtime_error("bad bytecode");
+		}
+	}
+	// blocks after the last return are never entered
+	for (llvm::BasicBlock &BB : *F) {
+		if (BB.getTerminator() == NULL) {
+			B.SetInsertPoint(&BB);
+			B.CreateUnreachable();
+		}
+	}
+}
+
+/// runTiered - interpret the program, compiling functions to native code
+/// once they have been called or looped threshold times. A function that
+/// gets hot inside a loop moves to native code at its next back-edge.
+inline int runTiered(const vmProgram &prog, uint32_t threshold, bool printStats) {
+	vmMachine m(prog);
+	vmTierJIT jit(m, printStats);
+	m.threshold = threshold;
+	m.tierUp = vmTierJIT::tierUp;
+	m.tierData = &jit;
+	return m.run();
+}
+
+#endif
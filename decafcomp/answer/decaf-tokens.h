@@ -0,0 +1,55 @@
+
+#ifndef _DECAF_TOKENS
+#define _DECAF_TOKENS
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+/// tokenBuffer - every token of a source, scanned ahead of the parse with
+/// --batch-lex. A struct of arrays, one entry per token: the parser walks
+/// it by index and only touches the arrays it needs, and a compilation
+/// refills the arrays of the last one instead of allocating. Token text
+/// is not copied, offset and length point into the source; identifiers
+/// are interned as they are scanned. The last token is the end of input
+/// (kind 0) or an error token (kind -1), whose message is error.
+class tokenBuffer {
+public:
+	vector<int> kind;
+	vector<uint32_t> offset;
+	vector<uint32_t> length;
+	vector<uint32_t> line;
+	vector<uint32_t> column;   // tokenpos, for syntax errors
+	vector<int> ident;         // the id of an identifier, -1 otherwise
+	const char *error;
+
+	tokenBuffer() : error(NULL) {}
+
+	size_t size() const { return kind.size(); }
+	void push(int k, uint32_t off, uint32_t len, uint32_t ln, uint32_t col, int id) {
+		kind.push_back(k);
+		offset.push_back(off);
+		length.push_back(len);
+		line.push_back(ln);
+		column.push_back(col);
+		ident.push_back(id);
+	}
+	// the capacity is kept for the next source
+	void clear() {
+		kind.clear();
+		offset.clear();
+		length.clear();
+		line.clear();
+		column.clear();
+		ident.clear();
+		error = NULL;
+	}
+	size_t bytes() const {
+		return (kind.capacity() + ident.capacity()) * sizeof(int)
+			+ (offset.capacity() + length.capacity() + line.capacity() + column.capacity()) * sizeof(uint32_t);
+	}
+};
+
+#endif
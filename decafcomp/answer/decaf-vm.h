@@ -0,0 +1,430 @@
+
+#ifndef _DECAF_VM
+#define _DECAF_VM
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "decaf-symtbl.h"
+
+using namespace std;
+
+// Register bytecode for the --vm backend. Every instruction has up to
+// three operands; a is the destination where there is one. Registers
+// are 32-bit slots of the current frame, bools are 0/1 and strings are
+// indexes into the program's string table.
+enum vmOpcode {
+	VM_CONST,    // a = b
+	VM_MOV,      // a = reg b
+	VM_LOADG,    // a = global b
+	VM_STOREG,   // global b = a
+	VM_LOADA,    // a = array b [reg c]
+	VM_STOREA,   // array b [reg c] = a
+	VM_ADD, VM_SUB, VM_MUL, VM_DIV, VM_MOD, VM_SHL, VM_SHR,
+	VM_LT, VM_LEQ, VM_GT, VM_GEQ, VM_EQ, VM_NEQ, VM_AND, VM_OR,   // a = b op c
+	VM_NEG, VM_NOT,   // a = op b
+	VM_JMP,      // goto a
+	VM_JZ,       // if (!a) goto b
+	VM_JNZ,      // if (a) goto b
+	VM_CALL,     // a = function b (regs c ..)
+	VM_RET,      // return a, or 0 if a < 0
+	VM_PRINTI,   // print_int(a)
+	VM_PRINTS,   // print_string(a)
+	VM_READI,    // a = read_int()
+	VM_NUMOPS
+};
+
+struct vmInsn {
+	int32_t op;
+	int32_t a, b, c;
+};
+
+struct vmFunction {
+	string name;
+	int index;   // position in vmProgram::functions
+	int nparams;
+	int nregs;
+	vector<vmInsn> code;
+	vmFunction() : index(-1), nparams(0), nregs(0) {}
+};
+
+struct vmArray {
+	int base;   // first slot in the globals
+	int size;
+};
+
+/// vmProgram - the output of the bytecode compiler: functions, global
+/// slots (scalars and array elements) and string constants.
+struct vmProgram {
+	deque<vmFunction> functions;
+	vector<vmArray> arrays;
+	vector<string> strings;
+	vector<int32_t> globalInit;
+	int mainIndex;
+	vmProgram() : mainIndex(-1) {}
+};
+
+/// vmSymbol - what an identifier stands for while compiling to bytecode.
+struct vmSymbol {
+	enum kind { LOCAL, GLOBAL, ARRAY, FUNCTION, BUILTIN } Kind;
+	int Index;   // register, global slot, array, function or vmOpcode
+};
+
+/// vmCompiler - state threaded through decafAST::Bytecode.
+/// Locals get a register for as long as their block is open, temporaries
+/// are allocated above them and released after every statement.
+class vmCompiler {
+	deque<vmSymbol> symbols;
+	struct loopLabels {
+		vector<int> breaks;
+		vector<int> continues;
+	};
+	vector<loopLabels> loops;
+	vector<int> blockTops;
+	int nextReg;
+	int localsTop;
+public:
+	vmProgram &prog;
+	scopedSymbolTable<vmSymbol> syms;
+	vmFunction *fn;
+
+	vmCompiler(vmProgram &p, symbolInterner &ids) : nextReg(0), localsTop(0), prog(p), syms(ids), fn(NULL) {}
+
+	void bind(int id, vmSymbol::kind kind, int index) {
+		vmSymbol s = { kind, index };
+		symbols.push_back(s);
+		syms.insert(id, &symbols.back());
+	}
+	vmSymbol *lookup(int id, const string &name) {
+		vmSymbol *s = syms.find(id);
+		if (s == NULL) {
+			throw runtime_error("unknown identifier " + name);
+		}
+		return s;
+	}
+
+	void beginFunction(vmFunction *f) {
+		fn = f;
+		nextReg = localsTop = 0;
+		blockTops.clear();
+		syms.push_scope();
+	}
+	void endFunction() {
+		emit(VM_RET, -1);
+		syms.pop_scope();
+		fn = NULL;
+	}
+	void beginBlock() { blockTops.push_back(localsTop); syms.push_scope(); }
+	void endBlock() {
+		syms.pop_scope();
+		localsTop = nextReg = blockTops.back();
+		blockTops.pop_back();
+	}
+
+	int temp() {
+		int r = nextReg++;
+		if (nextReg > fn->nregs) {
+			fn->nregs = nextReg;
+		}
+		return r;
+	}
+	int local() {
+		int r = temp();
+		localsTop = nextReg;
+		return r;
+	}
+	void endStatement() { nextReg = localsTop; }
+
+	int here() { return fn->code.size(); }
+	int emit(int op, int a = 0, int b = 0, int c = 0) {
+		vmInsn i = { op, a, b, c };
+		fn->code.push_back(i);
+		return fn->code.size() - 1;
+	}
+	// point the jump at pc to target
+	void patch(int pc, int target) {
+		vmInsn &i = fn->code[pc];
+		if (i.op == VM_JMP) {
+			i.a = target;
+		} else {
+			i.b = target;
+		}
+	}
+	int stringConstant(const string &s) {
+		prog.strings.push_back(s);
+		return prog.strings.size() - 1;
+	}
+
+	void beginLoop() { loops.push_back(loopLabels()); }
+	void addBreak(int pc) {
+		if (loops.empty()) {
+			throw runtime_error("break outside of a loop");
+		}
+		loops.back().breaks.push_back(pc);
+	}
+	void addContinue(int pc) {
+		if (loops.empty()) {
+			throw runtime_error("continue outside of a loop");
+		}
+		loops.back().continues.push_back(pc);
+	}
+	void endLoop(int continueTarget, int breakTarget) {
+		for (size_t i = 0; i < loops.back().continues.size(); i++) {
+			patch(loops.back().continues[i], continueTarget);
+		}
+		for (size_t i = 0; i < loops.back().breaks.size(); i++) {
+			patch(loops.back().breaks[i], breakTarget);
+		}
+		loops.pop_back();
+	}
+};
+
+// Native code for a function. Called with entry 0 regs holds just the
+// arguments; any other entry is the pc of a loop head to resume at, with
+// regs holding the whole frame of the interpreted activation.
+typedef int32_t (*vmNativeFn)(int32_t *regs, int32_t entry);
+
+/// vmMachine - the interpreter state for one run of a program.
+/// A function can be swapped for native code at any time by filling in
+/// its native slot; every call, from bytecode or from native code,
+/// goes through that table. With a threshold set, each call and loop
+/// back-edge heats its function and tierUp is asked to compile the
+/// function once it gets hot.
+class vmMachine {
+	static const size_t stackSlots = 1 << 22;
+	unique_ptr<int32_t[]> stack;
+	int32_t *stackTop;   // first slot not used by an interpreter frame
+	int32_t *stackEnd;
+	int32_t execute(const vmFunction *fn, int32_t *regs);
+	void heat(int fnIndex) {
+		if (++heatCount[fnIndex] == threshold && tierUp != NULL) {
+			tierUp(*this, fnIndex, tierData);
+		}
+	}
+public:
+	const vmProgram &prog;
+	vector<int32_t> globals;
+	vector<vmNativeFn> native;
+	vector<uint32_t> heatCount;
+	uint32_t threshold;   // 0 never tiers up
+	void (*tierUp)(vmMachine &m, int fnIndex, void *data);
+	void *tierData;
+
+	vmMachine(const vmProgram &p)
+		// left uninitialized so only the pages actually used get touched
+		: stack(new int32_t[stackSlots]), stackTop(stack.get()), stackEnd(stack.get() + stackSlots),
+		  prog(p), globals(p.globalInit), native(p.functions.size(), (vmNativeFn)NULL),
+		  heatCount(p.functions.size(), 0), threshold(0), tierUp(NULL), tierData(NULL) {}
+
+	/// call - run function fnIndex on args, natively if it has been compiled.
+	int32_t call(int fnIndex, int32_t *args) {
+		if (native[fnIndex] == NULL && threshold != 0) {
+			heat(fnIndex);
+		}
+		if (native[fnIndex] != NULL) {
+			return native[fnIndex](args, 0);
+		}
+		const vmFunction *fn = &prog.functions[fnIndex];
+		int32_t *regs = stackTop;
+		if (regs + fn->nregs > stackEnd) {
+			throw runtime_error("stack overflow");
+		}
+		for (int i = 0; i < fn->nparams; i++) {
+			regs[i] = args[i];
+		}
+		int32_t result = execute(fn, regs);
+		stackTop = regs;
+		return result;
+	}
+
+	/// run - execute the program's main and return its result.
+	int run() {
+		if (prog.mainIndex < 0) {
+			throw runtime_error("no main method");
+		}
+		int32_t result = call(prog.mainIndex, NULL);
+		fflush(stdout);
+		return result;
+	}
+};
+
+/// execute - interpret fn with its arguments already in regs.
+/// Dispatch jumps straight from one handler to the next through a label
+/// table (computed goto) where the compiler supports it, and falls back
+/// to a switch otherwise.
+inline int32_t vmMachine::execute(const vmFunction *fn, int32_t *regs) {
+	struct frame {
+		const vmFunction *fn;
+		const vmInsn *ret;
+		int32_t *regs;
+		int dst;
+	};
+	vector<frame> frames;
+	const vmInsn *pc = fn->code.data();
+	int32_t *g = globals.data();
+	int32_t result = 0;
+	frame f = { fn, NULL, regs, -1 };
+	frames.push_back(f);
+
+#if defined(__GNUC__)
+	static void *labels[VM_NUMOPS] = {
+		&&op_const, &&op_mov, &&op_loadg, &&op_storeg, &&op_loada, &&op_storea,
+		&&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod, &&op_shl, &&op_shr,
+		&&op_lt, &&op_leq, &&op_gt, &&op_geq, &&op_eq, &&op_neq, &&op_and, &&op_or,
+		&&op_neg, &&op_not, &&op_jmp, &&op_jz, &&op_jnz, &&op_call, &&op_ret,
+		&&op_printi, &&op_prints, &&op_readi
+	};
+#define VM_CASE(name, op) name:
+#define VM_NEXT() goto *labels[pc->op]
+	VM_NEXT();
+#else
+#define VM_CASE(name, op) case op:
+#define VM_NEXT() goto dispatch
+dispatch:
+	switch (pc->op) {
+#endif
+	VM_CASE(op_const, VM_CONST) regs[pc->a] = pc->b; pc++; VM_NEXT();
+	VM_CASE(op_mov, VM_MOV) regs[pc->a] = regs[pc->b]; pc++; VM_NEXT();
+	VM_CASE(op_loadg, VM_LOADG) regs[pc->a] = g[pc->b]; pc++; VM_NEXT();
+	VM_CASE(op_storeg, VM_STOREG) g[pc->b] = regs[pc->a]; pc++; VM_NEXT();
+	VM_CASE(op_loada, VM_LOADA) {
+		const vmArray &arr = prog.arrays[pc->b];
+		uint32_t i = regs[pc->c];
+		if (i >= (uint32_t)arr.size) {
+			throw runtime_error("array index out of bounds");
+		}
+		regs[pc->a] = g[arr.base + i];
+		pc++;
+		VM_NEXT();
+	}
+	VM_CASE(op_storea, VM_STOREA) {
+		const vmArray &arr = prog.arrays[pc->b];
+		uint32_t i = regs[pc->c];
+		if (i >= (uint32_t)arr.size) {
+			throw runtime_error("array index out of bounds");
+		}
+		g[arr.base + i] = regs[pc->a];
+		pc++;
+		VM_NEXT();
+	}
+	// arithmetic wraps like the i32 operations of the LLVM backend, and
+	// both take a shift amount mod 32
+	VM_CASE(op_add, VM_ADD) regs[pc->a] = (uint32_t)regs[pc->b] + (uint32_t)regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_sub, VM_SUB) regs[pc->a] = (uint32_t)regs[pc->b] - (uint32_t)regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_mul, VM_MUL) regs[pc->a] = (uint32_t)regs[pc->b] * (uint32_t)regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_div, VM_DIV)
+		if (regs[pc->c] == 0) {
+			throw runtime_error("division by zero");
+		}
+		regs[pc->a] = regs[pc->c] == -1 ? -(uint32_t)regs[pc->b] : regs[pc->b] / regs[pc->c];
+		pc++;
+		VM_NEXT();
+	VM_CASE(op_mod, VM_MOD)
+		if (regs[pc->c] == 0) {
+			throw runtime_error("division by zero");
+		}
+		regs[pc->a] = regs[pc->c] == -1 ? 0 : regs[pc->b] % regs[pc->c];
+		pc++;
+		VM_NEXT();
+	VM_CASE(op_shl, VM_SHL) regs[pc->a] = (uint32_t)regs[pc->b] << (regs[pc->c] & 31); pc++; VM_NEXT();
+	VM_CASE(op_shr, VM_SHR) regs[pc->a] = (uint32_t)regs[pc->b] >> (regs[pc->c] & 31); pc++; VM_NEXT();
+	VM_CASE(op_lt, VM_LT) regs[pc->a] = regs[pc->b] < regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_leq, VM_LEQ) regs[pc->a] = regs[pc->b] <= regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_gt, VM_GT) regs[pc->a] = regs[pc->b] > regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_geq, VM_GEQ) regs[pc->a] = regs[pc->b] >= regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_eq, VM_EQ) regs[pc->a] = regs[pc->b] == regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_neq, VM_NEQ) regs[pc->a] = regs[pc->b] != regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_and, VM_AND) regs[pc->a] = regs[pc->b] & regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_or, VM_OR) regs[pc->a] = regs[pc->b] | regs[pc->c]; pc++; VM_NEXT();
+	VM_CASE(op_neg, VM_NEG) regs[pc->a] = -(uint32_t)regs[pc->b]; pc++; VM_NEXT();
+	VM_CASE(op_not, VM_NOT) regs[pc->a] = !regs[pc->b]; pc++; VM_NEXT();
+	VM_CASE(op_jmp, VM_JMP)
+		// a backward jump closes a loop
+		if (pc->a <= pc - fn->code.data() && threshold != 0) {
+			if (native[fn->index] == NULL) {
+				heat(fn->index);
+			}
+			if (native[fn->index] != NULL) {
+				// on-stack replacement: finish this activation natively
+				stackTop = regs + fn->nregs;
+				result = native[fn->index](regs, pc->a);
+				goto leave;
+			}
+		}
+		pc = fn->code.data() + pc->a;
+		VM_NEXT();
+	VM_CASE(op_jz, VM_JZ) pc = regs[pc->a] ? pc + 1 : fn->code.data() + pc->b; VM_NEXT();
+	VM_CASE(op_jnz, VM_JNZ) pc = regs[pc->a] ? fn->code.data() + pc->b : pc + 1; VM_NEXT();
+	VM_CASE(op_call, VM_CALL) {
+		if (native[pc->b] == NULL && threshold != 0) {
+			heat(pc->b);
+		}
+		if (native[pc->b] != NULL) {
+			// native code may call back into the interpreter above this frame
+			stackTop = regs + fn->nregs;
+			regs[pc->a] = native[pc->b](regs + pc->c, 0);
+			pc++;
+			VM_NEXT();
+		}
+		const vmFunction *callee = &prog.functions[pc->b];
+		int32_t *calleeRegs = regs + fn->nregs;
+		if (calleeRegs + callee->nregs > stackEnd) {
+			throw runtime_error("stack overflow");
+		}
+		for (int i = 0; i < callee->nparams; i++) {
+			calleeRegs[i] = regs[pc->c + i];
+		}
+		frame f = { callee, pc + 1, calleeRegs, pc->a };
+		frames.push_back(f);
+		fn = callee;
+		regs = calleeRegs;
+		pc = fn->code.data();
+		VM_NEXT();
+	}
+	VM_CASE(op_ret, VM_RET)
+		result = pc->a < 0 ? 0 : regs[pc->a];
+	leave: {
+		frame done = frames.back();
+		frames.pop_back();
+		if (frames.empty()) {
+			goto finish;
+		}
+		fn = frames.back().fn;
+		regs = frames.back().regs;
+		regs[done.dst] = result;
+		pc = done.ret;
+		VM_NEXT();
+	}
+	VM_CASE(op_printi, VM_PRINTI) printf("%d", regs[pc->a]); pc++; VM_NEXT();
+	VM_CASE(op_prints, VM_PRINTS) printf("%s", prog.strings[regs[pc->a]].c_str()); pc++; VM_NEXT();
+	VM_CASE(op_readi, VM_READI) {
+		int i = 0;
+		if (scanf("%d", &i) != 1) {
+			i = 0;
+		}
+		regs[pc->a] = i;
+		pc++;
+		VM_NEXT();
+	}
+#if !defined(__GNUC__)
+	default:
+		throw runtime_error("bad bytecode");
+	}
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+finish:
+	return result;
+}
+
+/// runVM - interpret the whole program and return its result.
+inline int runVM(const vmProgram &prog) {
+	vmMachine m(prog);
+	return m.run();
+}
+
+#endif
@@ -1,17 +1,32 @@
 
 #include "default-defs.h"
-#include <list>
+#include "decaf-print.h"
+#include <cstdint>
 #include <utility>
-#include <map>
 #include <ostream>
 #include <iostream>
 #include <sstream>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/Argument.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/raw_ostream.h"
+#include "decaf-symtbl.h"
+#include "decaf-vm.h"
+#include "decaf-ssa.h"
+#include "decaf-compiler.h"
 
 #ifndef YYTOKENTYPE
 #include "decafcomp.tab.h"
@@ -19,112 +34,234 @@
 
 using namespace std;
 
+// the compilation this thread works for; its arena owns every AST node
+// and token string, its interner the identifiers
+static thread_local CompilerInstance *TheCompiler = NULL;
+
+// the codegen state below is per thread and pointed at a compilation by
+// beginCodegen, so that with -j<N> every worker generates its methods
+// into a context and module of its own
+
 // this global variable contains all the generated code
-static llvm::Module *TheModule;
+static thread_local llvm::Module *TheModule;
 
 // this is the method used to construct the LLVM intermediate code (IR)
-static llvm::LLVMContext TheContext;
-static llvm::IRBuilder<> Builder(TheContext);
-static llvm::Function *TheFunction = 0;
+static thread_local llvm::LLVMContext *TheContext = NULL;
+static thread_local llvm::IRBuilder<> *Builder = NULL;
+static thread_local llvm::Function *TheFunction = 0;
+// where break and continue jump to in the enclosing loops
+struct loopTargets {
+	llvm::BasicBlock *continueBB;
+	llvm::BasicBlock *breakBB;
+};
+static thread_local vector<loopTargets> loopStack;
+// what an enclosing counted loop proves about its counter in the body:
+// it moves from first towards bound, which the test compares it with
+struct counterRange {
+	ssaVariable *counter;
+	llvm::WeakTrackingVH first;   // counter and bound as of the preheader
+	llvm::WeakTrackingVH bound;
+	decafOp test;
+	int32_t step;
+	llvm::BasicBlock *preheader;
+	// may fits be tested at runtime, in a second copy of the loop? Only
+	// innermost loops are copied, nested copies would double with depth
+	bool versioned;
+	map<uint64_t, llvm::Value *> fits;   // per array size
+};
+static thread_local vector<counterRange> rangeStack;
 // the calls to TheContext in the init above and in the
 // following code ensures that we are incrementally generating
 // instructions in the right order
 
 
 typedef llvm::Value descriptor;
-typedef map<string, descriptor* > symbol_table;
-typedef list<symbol_table > symbol_table_list;
-symbol_table_list symtbl;
-
-
-descriptor* access_symtbl(string ident) {
-    for (auto i : symtbl) {
-        auto find_ident = i.find(ident);
-        if (find_ident != i.end()) {
-            return find_ident->second;
-        }
-    }
-    return NULL;
+typedef scopedSymbolTable<descriptor> symbol_table;
+thread_local symbol_table symtbl;
+
+
+descriptor* access_symtbl(int ident) {
+    return symtbl.find(ident);
 }
 
+// locals and parameters have no storage, their values are tracked by
+// SSA as the code is generated; localtbl shadows symtbl and is scoped
+// along with it
+thread_local ssaBuilder SSA;
+thread_local scopedSymbolTable<ssaVariable> localtbl;
 
+ssaVariable *access_local(int ident) {
+    return localtbl.find(ident);
+}
 
-llvm::Type *getLLVMType(string ty) {
-	if(ty == "VoidType")
-		return Builder.getVoidTy();
-	else if(ty == "IntType")
-		return Builder.getInt32Ty();
-	else if(ty == "BoolType")
-		return Builder.getInt1Ty();
-	else if(ty == "StringType")
-		return Builder.getInt8PtrTy();
-	else
-		throw runtime_error("unknown type");  
+const string &idName(int ident) {
+    return TheCompiler->identifiers.name(ident);
 }
 
-llvm::Constant *getZeroInit(string ty) {
-		if(ty == "IntType") 
-			return Builder.getInt32(0);
-		else if(ty == "BoolType")
-			return Builder.getInt1(0);
-		else
-			throw runtime_error("unknown type");
+// every method of the package by name, filled before any body is
+// generated; the workers of -j<N> get a copy
+class MethodDeclAST;
+static thread_local llvm::DenseMap<int, MethodDeclAST *> methodDecls;
+
+// point this thread's code generator at a compilation, and at the
+// context, builder and module to generate into
+void beginCodegen(CompilerInstance *ci, llvm::LLVMContext *context, llvm::IRBuilder<> *builder, llvm::Module *module) {
+	TheCompiler = ci;
+	TheContext = context;
+	Builder = builder;
+	TheModule = module;
+	TheFunction = NULL;
+	symtbl.reset(ci->identifiers);
+	localtbl.reset(ci->identifiers);
+	SSA.startFunction();
+	loopStack.clear();
+	rangeStack.clear();
+	methodDecls.clear();
+}
+
+// forget the compilation, its context may go away now
+void endCodegen() {
+	SSA.startFunction();
+	loopStack.clear();
+	rangeStack.clear();
+	methodDecls.clear();
+	TheCompiler = NULL;
+	TheContext = NULL;
+	Builder = NULL;
+	TheModule = NULL;
+	TheFunction = NULL;
+}
+
+
+
+// names used when printing the AST
+static const char *opNames[] = {
+	"Plus", "Minus", "Mult", "Div", "Mod", "Leftshift", "Rightshift",
+	"Lt", "Leq", "Gt", "Geq", "Eq", "Neq", "And", "Or",
+	"UnaryMinus", "Not"
+};
+static const char *typeNames[] = { "VoidType", "IntType", "BoolType", "StringType" };
+
+string opName(decafOp op) { return opNames[op]; }
+string typeName(decafType ty) { return typeNames[ty]; }
+
+llvm::Type *getLLVMType(decafType ty) {
+	switch (ty) {
+	case TY_VOID: return Builder->getVoidTy();
+	case TY_INT: return Builder->getInt32Ty();
+	case TY_BOOL: return Builder->getInt1Ty();
+	case TY_STRING: return Builder->getInt8PtrTy();
+	}
+	throw runtime_error("unknown type");
 }
 
+llvm::Constant *getZeroInit(decafType ty) {
+	switch (ty) {
+	case TY_INT: return Builder->getInt32(0);
+	case TY_BOOL: return Builder->getInt1(0);
+	default: break;
+	}
+	throw runtime_error("unknown type");
+}
+
+// operators deep an expression may be and still be evaluated without a branch
+const int cheapDepth = 4;
 
 /// decafAST - Base class for all abstract syntax tree nodes.
 class decafAST {
 public:
+  // nodes live in the compilation's arena and are freed together by its reset()
+  static void *operator new(size_t size) { return TheCompiler->arena.allocate(size); }
+  static void operator delete(void *) {}
+  decafAST() { TheCompiler->arena.own(this); TheCompiler->arena.countNode(); }
   virtual ~decafAST() {}
-  virtual string str() { return string(""); }
+  virtual void print(astSink &out) {}
+  // the printed form of a single node, e.g. an identifier or array size
+  string str() { astSink s; print(s); return s.str(); }
   virtual llvm::Value *Codegen() = 0;
+  // declare what Codegen defines, for a module that only refers to it
+  virtual llvm::Value *Declare() { return Codegen(); }
+  // lower to VM bytecode, returns the register holding the value or -1
+  virtual int Bytecode(vmCompiler &vc) { throw runtime_error("not supported by the bytecode backend"); }
+  // value of a constant expression, used for global initializers
+  virtual bool constantValue(int32_t &v) { return false; }
+  // the pieces of a variable read, binary expression or scalar
+  // assignment, used to recognize counted for loops
+  virtual bool variableName(int &id) { return false; }
+  virtual bool binaryParts(decafOp &op, decafAST *&left, decafAST *&right) { return false; }
+  virtual bool assignParts(int &id, decafAST *&value) { return false; }
+  // does this statement assign to the variable id anywhere inside it?
+  virtual bool assigns(int id) { return false; }
+  // is there a for loop anywhere inside this statement?
+  virtual bool containsFor() { return false; }
+  // can this expression be evaluated when it is not needed: no calls,
+  // no traps and only a few instructions; depth counts the operators
+  // above it, anything nested deeper than cheapDepth is not cheap
+  virtual bool isCheap(int depth = 0) { return false; }
 };
 
-string getString(decafAST *d) {
+astSink &operator<<(astSink &out, decafAST *d) {
 	if (d != NULL) {
-		return d->str();
+		d->print(out);
 	} else {
-		return string("None");
+		out << "None";
 	}
+	return out;
+}
+
+string getString(decafAST *d) {
+	astSink s;
+	s << d;
+	return s.str();
 }
 
 template <class T>
-string commaList(list<T> vec) {
-    string s("");
-    for (typename list<T>::iterator i = vec.begin(); i != vec.end(); i++) { 
-        s = s + (s.empty() ? string("") : string(",")) + (*i)->str(); 
-    }   
-    if (s.empty()) {
-        s = string("None");
-    }   
-    return s;
+void printList(astSink &out, llvm::ArrayRef<T> vec) {
+	if (vec.empty()) {
+		out << "None";
+		return;
+	}
+	for (typename llvm::ArrayRef<T>::const_iterator i = vec.begin(); i != vec.end(); i++) {
+		if (i != vec.begin()) {
+			out << ",";
+		}
+		out << *i;
+	}
 }
 
 template <class T>
-llvm::Value *listCodegen(list<T> vec) {
+llvm::Value *listCodegen(llvm::ArrayRef<T> vec) {
   llvm::Value *val = NULL;
-  for (typename list<T>::iterator i = vec.begin(); i != vec.end(); i++) { 
+  for (typename llvm::ArrayRef<T>::iterator i = vec.begin(); i != vec.end(); i++) { 
      llvm::Value *j = (*i)->Codegen();
        if (j != NULL) { val = j; }
      } 
   return val;
 }
 class VarDefAST : public decafAST {
-	string Name;
-	string Type;
+	int Name;
+	decafType Type;
 public:
-	VarDefAST(string name, string type): Name(name), Type(type) {}
-	string returnType() { return Type;}
-	string returnName() { return Name;}
-	string str() {return string("VarDef") + "(" + Name + "," + Type + ")" ;}
+	VarDefAST(int name, decafType type): Name(name), Type(type) {}
+	decafType returnType() { return Type;}
+	int returnName() { return Name;}
+	void print(astSink &out) { out << "VarDef(" << idName(Name) << "," << typeName(Type) << ")"; }
 	llvm::Value* Codegen(){
 		//if(Builder.GetInsertBlock()->getParent() == NULL)
 		//	throw runtime_error("VarDefAST get parent error");
 		llvm::Type* llType = getLLVMType(Type);
-		llvm::AllocaInst*Alloca= Builder.CreateAlloca(llType, 0, Name.c_str());
-		symtbl.front().insert(pair<string, descriptor*>(Name, Alloca));
-
-		return Alloca;
+		ssaVariable *var = SSA.declare(llType, idName(Name));
+		localtbl.insert(Name, var);
+		// locals start out zero
+		llvm::Value *zero = getZeroInit(Type);
+		SSA.write(var, Builder->GetInsertBlock(), zero);
+		return zero;
+	}
+	int Bytecode(vmCompiler &vc) {
+		int r = vc.local();
+		vc.bind(Name, vmSymbol::LOCAL, r);
+		vc.emit(VM_CONST, r, 0);
+		return -1;
 	}
 	llvm::Type* llvmTypeReturn(){
 		return getLLVMType(Type);
@@ -134,23 +271,18 @@ public:
 
 /// decafStmtList - List of Decaf statements
 class decafStmtList : public decafAST {
-	list<decafAST *> stmts;
+	arenaVector<decafAST *, 4> stmts;
 public:
-	decafStmtList() {}
-	~decafStmtList() {
-		for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++) { 
-			delete *i;
-		}
-	}
+	decafStmtList() : stmts(TheCompiler->arena) {}
 	int size() { return stmts.size(); }
 	decafAST* lastElement() { return stmts.back(); }
 	void push_front(decafAST *e) { stmts.push_front(e); }
 	void push_back(decafAST *e) { stmts.push_back(e); }
-	string str() { return commaList<class decafAST *>(stmts); }
+	void print(astSink &out) { printList(out, returnList()); }
 	vector<llvm::Type *> returnArgs() {
 		vector<llvm::Type*> toReturn;
 		VarDefAST* temp;
-		for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++) { 
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) { 
 			temp = (VarDefAST*)(*i);
      		llvm::Type *j = temp->llvmTypeReturn();
        		if (j != NULL) { toReturn.push_back((llvm::Type*)j); }
@@ -160,7 +292,7 @@ public:
 	}
 	vector<llvm::Type *> returnArgsE() {
 		vector<llvm::Type*> toReturn;
-		for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++) { 
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) { 
      		llvm::Type *j = (llvm::Type *)(*i)->Codegen();
        		if (j != NULL) { toReturn.push_back((llvm::Type*)j); }
      	} 
@@ -169,47 +301,74 @@ public:
 	}
 	vector<llvm::Value *> returnArgsV() {
 		vector<llvm::Value*> toReturn;
-		for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++) { 
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) { 
      		llvm::Value *j = (*i)->Codegen();
        		if (j != NULL) { toReturn.push_back(j); }
      	} 
      	return toReturn;
 
 	}
-	list<decafAST *> returnList(){
-		return stmts;
+	bool assigns(int id) {
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) {
+			if ((*i)->assigns(id)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	bool containsFor() {
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) {
+			if ((*i)->containsFor()) {
+				return true;
+			}
+		}
+		return false;
+	}
+	// read-only view of the children, valid as long as the list is
+	llvm::ArrayRef<decafAST *> returnList(){
+		return llvm::ArrayRef<decafAST *>(stmts.data(), stmts.size());
 	}
   	llvm::Value *Codegen() {
-    	return listCodegen<decafAST *>(stmts);
+    	return listCodegen<decafAST *>(returnList());
   	}
+	llvm::Value *Declare() {
+		llvm::Value *val = NULL;
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) {
+			val = (*i)->Declare();
+		}
+		return val;
+	}
+	int Bytecode(vmCompiler &vc) {
+		int r = -1;
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) {
+			r = (*i)->Bytecode(vc);
+		}
+		return r;
+	}
+	// statements run one after another, each frees its temporaries
+	void stmtBytecode(vmCompiler &vc) {
+		for (decafAST **i = stmts.begin(); i != stmts.end(); i++) {
+			(*i)->Bytecode(vc);
+			vc.endStatement();
+		}
+	}
 
 };
 
 class PackageAST : public decafAST {
-	string Name;
+	int Name;
 	decafStmtList *FieldDeclList;
 	decafStmtList *MethodDeclList;
 public:
-	PackageAST(string name, decafStmtList *fieldlist, decafStmtList *methodlist) 
+	PackageAST(int name, decafStmtList *fieldlist, decafStmtList *methodlist) 
 		: Name(name), FieldDeclList(fieldlist), MethodDeclList(methodlist) {}
-	~PackageAST() { 
-		if (FieldDeclList != NULL) { delete FieldDeclList; }
-		if (MethodDeclList != NULL) { delete MethodDeclList; }
-	}
-	string str() { 
-		return string("Package") + "(" + Name + "," + getString(FieldDeclList) + "," + getString(MethodDeclList) + ")";
-	}
-	llvm::Value *Codegen() { 
-		llvm::Value *val = NULL;
-		if (NULL != FieldDeclList) {
-			val = FieldDeclList->Codegen();
-		}
-		if (NULL != MethodDeclList) {
-			val = MethodDeclList->Codegen();
-		} 
-		// Q: should we enter the class name into the symbol table?
-		return val; 
+	void print(astSink &out) {
+		out << "Package(" << idName(Name) << "," << FieldDeclList << "," << MethodDeclList << ")";
 	}
+	void declareMethods();
+	llvm::Value *Codegen();
+	llvm::Value *parallelCodegen(decafStmtList *externs);
+	int Bytecode(vmCompiler &vc);
 };
 
 /// ProgramAST - the decaf program
@@ -218,22 +377,31 @@ class ProgramAST : public decafAST {
 	PackageAST *PackageDef;
 public:
 	ProgramAST(decafStmtList *externs, PackageAST *c) : ExternList(externs), PackageDef(c) {}
-	~ProgramAST() { 
-		if (ExternList != NULL) { delete ExternList; } 
-		if (PackageDef != NULL) { delete PackageDef; }
-	}
-	string str() { return string("Program") + "(" + getString(ExternList) + "," + getString(PackageDef) + ")"; }
+	void print(astSink &out) { out << "Program(" << ExternList << "," << PackageDef << ")"; }
 	llvm::Value *Codegen() { 
 		llvm::Value *val = NULL;
 		if (NULL != ExternList) {
 			val = ExternList->Codegen();
 		}
-		if (NULL != PackageDef) {
-			val = PackageDef->Codegen();
-		} else {
+		if (NULL == PackageDef) {
+			throw runtime_error("no package definition in decaf program");
+		}
+		if (TheCompiler->options.perMethod()) {
+			return PackageDef->parallelCodegen(ExternList);
+		}
+		return PackageDef->Codegen();
+	}
+	int Bytecode(vmCompiler &vc) {
+		if (NULL == PackageDef) {
 			throw runtime_error("no package definition in decaf program");
 		}
-		return val; 
+		vc.syms.push_scope();
+		if (NULL != ExternList) {
+			ExternList->Bytecode(vc);
+		}
+		PackageDef->Bytecode(vc);
+		vc.syms.pop_scope();
+		return -1;
 	}
 };
 
@@ -242,16 +410,16 @@ class BlockAST : public decafAST {
 	decafStmtList *statement_list;
 public:
 	BlockAST(decafStmtList* vList, decafStmtList* sList): varDefList(vList), statement_list(sList) {} 
-	~BlockAST(){ 
-		if(varDefList != NULL) {delete varDefList;}
-		if(statement_list != NULL) {delete statement_list;}
-	}
-	string str() { return string("Block") + "(" + getString(varDefList) + "," + getString(statement_list) + ")"; }
+	void print(astSink &out) { out << "Block(" << varDefList << "," << statement_list << ")"; }
+	bool assigns(int id) { return statement_list->assigns(id); }
+	bool containsFor() { return statement_list->containsFor(); }
 	llvm::Value* Codegen(){
 		//llvm::BasicBlock*BB = llvm::BasicBlock::Create(TheContext, "entry", (llvm::Function*)access_symtbl("func"));
-		//symtbl.front().insert(pair<string, descriptor*>(string("entry"),(llvm::Value*) BB));
+		//symtbl.insert(string("entry"), (llvm::Value*) BB);
 		//Builder.SetInsertPoint(BB);
 		llvm::Value *val = NULL;
+		symtbl.push_scope();
+		localtbl.push_scope();
 		if (NULL != varDefList) {
 			val = varDefList->Codegen();
 		}else {
@@ -262,8 +430,17 @@ public:
 		} else {
 			throw runtime_error("Block AST Problem");
 		}
+		localtbl.pop_scope();
+		symtbl.pop_scope();
 		return val;
 	}
+	int Bytecode(vmCompiler &vc) {
+		vc.beginBlock();
+		varDefList->Bytecode(vc);
+		statement_list->stmtBytecode(vc);
+		vc.endBlock();
+		return -1;
+	}
 };
 
 
@@ -271,15 +448,33 @@ public:
 class BreakStatementAST : public decafAST {
 public:
 	BreakStatementAST() {}
-	string str() {return string("BreakStmt");}
-	llvm::Value *Codegen() { return 0;}
+	void print(astSink &out) { out << "BreakStmt"; }
+	llvm::Value *Codegen() {
+		if (loopStack.empty()) {
+			throw runtime_error("break outside of a loop");
+		}
+		llvm::Value *val = Builder->CreateBr(loopStack.back().breakBB);
+		Builder->SetInsertPoint(llvm::BasicBlock::Create(*TheContext, "afterbreak", Builder->GetInsertBlock()->getParent()));
+		SSA.seal(Builder->GetInsertBlock());
+		return val;
+	}
+	int Bytecode(vmCompiler &vc) { vc.addBreak(vc.emit(VM_JMP)); return -1; }
 };
 
 class ContinueStatementAST: public decafAST {
 public:
 	ContinueStatementAST() {}
-	string str() {return string("ContinueStmt");}
-	llvm::Value *Codegen() { return 0;}
+	void print(astSink &out) { out << "ContinueStmt"; }
+	llvm::Value *Codegen() {
+		if (loopStack.empty()) {
+			throw runtime_error("continue outside of a loop");
+		}
+		llvm::Value *val = Builder->CreateBr(loopStack.back().continueBB);
+		Builder->SetInsertPoint(llvm::BasicBlock::Create(*TheContext, "aftercontinue", Builder->GetInsertBlock()->getParent()));
+		SSA.seal(Builder->GetInsertBlock());
+		return val;
+	}
+	int Bytecode(vmCompiler &vc) { vc.addContinue(vc.emit(VM_JMP)); return -1; }
 };
 
 class ReturnStatementAST: public decafAST {
@@ -287,10 +482,22 @@ class ReturnStatementAST: public decafAST {
 public:
 	ReturnStatementAST(decafAST *input): expr(input) {}
 	ReturnStatementAST(): expr(NULL) {}
-	~ReturnStatementAST() {if (expr != NULL) { delete expr; } }
-	string str() { return string("ReturnStmt") + "(" + getString(expr) + ")" ;}
+	void print(astSink &out) { out << "ReturnStmt(" << expr << ")"; }
 	llvm::Value *Codegen() { 
-		return Builder.CreateRet(expr->Codegen());
+		llvm::Value *val;
+		if (expr == NULL)
+			val = Builder->CreateRetVoid();
+		else
+			val = Builder->CreateRet(expr->Codegen());
+		// anything after the return is unreachable, give it its own block
+		// so every block keeps a single terminator
+		Builder->SetInsertPoint(llvm::BasicBlock::Create(*TheContext, "afterret", Builder->GetInsertBlock()->getParent()));
+		SSA.seal(Builder->GetInsertBlock());
+		return val;
+	}
+	int Bytecode(vmCompiler &vc) {
+		vc.emit(VM_RET, expr == NULL ? -1 : expr->Bytecode(vc));
+		return -1;
 	}
 };
 
@@ -302,14 +509,27 @@ class ForStmtAST: public decafAST {
 	decafAST *block;
 public:
 	ForStmtAST(decafStmtList *pre, decafAST* constant, decafStmtList *loop, decafAST *inputBlock): pre_assign_list(pre), loop_assign(loop), expr(constant), block(inputBlock) {}
-	~ForStmtAST() { 
-		if (pre_assign_list != NULL) { delete pre_assign_list; } 
-		if (loop_assign != NULL) { delete loop_assign; }
-		if (expr != NULL) { delete expr; }
-		if (block != NULL) { delete block; }
+	void print(astSink &out) { out << "ForStmt(" << pre_assign_list << "," << expr << "," << loop_assign << "," << block << ")"; }
+	bool assigns(int id) { return pre_assign_list->assigns(id) || loop_assign->assigns(id) || block->assigns(id); }
+	bool containsFor() { return true; }
+	bool isCounted(int &counter, int32_t &step, decafOp &test, decafAST *&bound);
+	bool pushRange(int counter, int32_t step, decafOp test, decafAST *bound, llvm::BasicBlock *preheader);
+	void rotatedLoop(llvm::BasicBlock *bodyBB, llvm::BasicBlock *exitBB);
+	llvm::Value *Codegen();
+	int Bytecode(vmCompiler &vc) {
+		pre_assign_list->stmtBytecode(vc);
+		int top = vc.here();
+		int exit = vc.emit(VM_JZ, expr->Bytecode(vc));
+		vc.endStatement();
+		vc.beginLoop();
+		block->Bytecode(vc);
+		int next = vc.here();
+		loop_assign->stmtBytecode(vc);
+		vc.emit(VM_JMP, top);
+		vc.patch(exit, vc.here());
+		vc.endLoop(next, vc.here());
+		return -1;
 	}
-	string str() {return string("ForStmt") + "(" + getString(pre_assign_list) + "," + getString(expr) + "," + getString(loop_assign) + ","+ getString(block)  + ")" ;}
-	llvm::Value *Codegen() { return 0;}
 };
 
 class IfStmtAST: public decafAST {
@@ -319,12 +539,9 @@ class IfStmtAST: public decafAST {
 public:
 	IfStmtAST(decafAST* inputExpr, decafAST* inputBlock, decafAST* inputElse): expr(inputExpr), block(inputBlock), elseBlock(inputElse) {}
 	IfStmtAST(decafAST* inputExpr, decafAST* inputBlock): expr(inputExpr), block(inputBlock) { elseBlock = NULL;}
-	~IfStmtAST() { 
-		if (block != NULL) { delete block; } 
-		if (expr != NULL) { delete expr; }
-		if (elseBlock != NULL) { delete elseBlock; }
-	}
-	string str() {return string("IfStmt") + "("+ getString(expr) + "," + getString(block) + "," + getString(elseBlock) +")";}
+	void print(astSink &out) { out << "IfStmt(" << expr << "," << block << "," << elseBlock << ")"; }
+	bool assigns(int id) { return block->assigns(id) || (elseBlock != NULL && elseBlock->assigns(id)); }
+	bool containsFor() { return block->containsFor() || (elseBlock != NULL && elseBlock->containsFor()); }
 	llvm::Value *Codegen() { 
 		llvm::Value* ifVal;
 		llvm::BasicBlock* trueBB;
@@ -335,38 +552,59 @@ public:
 			throw runtime_error("Invalid ifstmt condition");
 		if(elseBlock == NULL)
 		{
-			entryBB = llvm::BasicBlock::Create(TheContext, "ifentry",Builder.GetInsertBlock()->getParent());
-			trueBB = llvm::BasicBlock::Create(TheContext, "iftrue",Builder.GetInsertBlock()->getParent());
-			endBB = llvm::BasicBlock::Create(TheContext, "ifend",Builder.GetInsertBlock()->getParent());
-			Builder.CreateBr(entryBB);
-			Builder.SetInsertPoint(entryBB);
+			entryBB = llvm::BasicBlock::Create(*TheContext, "ifentry",Builder->GetInsertBlock()->getParent());
+			trueBB = llvm::BasicBlock::Create(*TheContext, "iftrue",Builder->GetInsertBlock()->getParent());
+			endBB = llvm::BasicBlock::Create(*TheContext, "ifend",Builder->GetInsertBlock()->getParent());
+			Builder->CreateBr(entryBB);
+			SSA.seal(entryBB);
+			Builder->SetInsertPoint(entryBB);
 			ifVal = expr->Codegen();
-			Builder.CreateCondBr(ifVal, trueBB, endBB);
-			Builder.SetInsertPoint(trueBB);
+			Builder->CreateCondBr(ifVal, trueBB, endBB);
+			SSA.seal(trueBB);
+			Builder->SetInsertPoint(trueBB);
 			block->Codegen();
-			Builder.CreateBr(endBB);
-			Builder.SetInsertPoint(endBB);
+			Builder->CreateBr(endBB);
+			SSA.seal(endBB);
+			Builder->SetInsertPoint(endBB);
 		}
 		else
 		{
-			entryBB = llvm::BasicBlock::Create(TheContext, "ifentry",Builder.GetInsertBlock()->getParent());
-			trueBB = llvm::BasicBlock::Create(TheContext, "iftrue",Builder.GetInsertBlock()->getParent());
-			elseBB = llvm::BasicBlock::Create(TheContext, "iffalse",Builder.GetInsertBlock()->getParent());
-			endBB = llvm::BasicBlock::Create(TheContext, "ifend",Builder.GetInsertBlock()->getParent());
-			Builder.CreateBr(entryBB);
-			Builder.SetInsertPoint(entryBB);
+			entryBB = llvm::BasicBlock::Create(*TheContext, "ifentry",Builder->GetInsertBlock()->getParent());
+			trueBB = llvm::BasicBlock::Create(*TheContext, "iftrue",Builder->GetInsertBlock()->getParent());
+			elseBB = llvm::BasicBlock::Create(*TheContext, "iffalse",Builder->GetInsertBlock()->getParent());
+			endBB = llvm::BasicBlock::Create(*TheContext, "ifend",Builder->GetInsertBlock()->getParent());
+			Builder->CreateBr(entryBB);
+			SSA.seal(entryBB);
+			Builder->SetInsertPoint(entryBB);
 			ifVal = expr->Codegen();
-			Builder.CreateCondBr(ifVal, trueBB, elseBB);
-			Builder.SetInsertPoint(trueBB);
+			Builder->CreateCondBr(ifVal, trueBB, elseBB);
+			SSA.seal(trueBB);
+			SSA.seal(elseBB);
+			Builder->SetInsertPoint(trueBB);
 			block->Codegen();
-			Builder.CreateBr(endBB);
-			Builder.SetInsertPoint(elseBB);
+			Builder->CreateBr(endBB);
+			Builder->SetInsertPoint(elseBB);
 			elseBlock->Codegen();
-			Builder.CreateBr(endBB);
-			Builder.SetInsertPoint(endBB);
+			Builder->CreateBr(endBB);
+			SSA.seal(endBB);
+			Builder->SetInsertPoint(endBB);
 		}
 		return endBB;
 	}
+	int Bytecode(vmCompiler &vc) {
+		int skip = vc.emit(VM_JZ, expr->Bytecode(vc));
+		vc.endStatement();
+		block->Bytecode(vc);
+		if (elseBlock != NULL) {
+			int end = vc.emit(VM_JMP);
+			vc.patch(skip, vc.here());
+			elseBlock->Bytecode(vc);
+			vc.patch(end, vc.here());
+		} else {
+			vc.patch(skip, vc.here());
+		}
+		return -1;
+	}
 };
 
 
@@ -375,32 +613,41 @@ class WhileStmtAST: public decafAST {
 	decafAST *block;
 public:
 	WhileStmtAST(decafAST* inputExpr, decafAST* inputBlock): expr(inputExpr), block(inputBlock) {}
-	~WhileStmtAST() { 
-		if (block != NULL) { delete block; } 
-		if (expr != NULL) { delete expr; }
+	void print(astSink &out) { out << "WhileStmt(" << expr << "," << block << ")"; }
+	bool assigns(int id) { return block->assigns(id); }
+	bool containsFor() { return block->containsFor(); }
+	llvm::Value *Codegen() {
+		llvm::Function *F = Builder->GetInsertBlock()->getParent();
+		llvm::BasicBlock *condBB = llvm::BasicBlock::Create(*TheContext, "whilecond", F);
+		llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(*TheContext, "whilebody", F);
+		llvm::BasicBlock *endBB = llvm::BasicBlock::Create(*TheContext, "whileend", F);
+		Builder->CreateBr(condBB);
+		Builder->SetInsertPoint(condBB);
+		Builder->CreateCondBr(expr->Codegen(), bodyBB, endBB);
+		SSA.seal(bodyBB);
+		Builder->SetInsertPoint(bodyBB);
+		loopTargets targets = { condBB, endBB };
+		loopStack.push_back(targets);
+		block->Codegen();
+		loopStack.pop_back();
+		Builder->CreateBr(condBB);
+		// the back edge and every break are in place now
+		SSA.seal(condBB);
+		SSA.seal(endBB);
+		Builder->SetInsertPoint(endBB);
+		return endBB;
+	}
+	int Bytecode(vmCompiler &vc) {
+		int top = vc.here();
+		int exit = vc.emit(VM_JZ, expr->Bytecode(vc));
+		vc.endStatement();
+		vc.beginLoop();
+		block->Bytecode(vc);
+		vc.emit(VM_JMP, top);
+		vc.patch(exit, vc.here());
+		vc.endLoop(top, vc.here());
+		return -1;
 	}
-	string str() {return string("WhileStmt") + "("+ getString(expr) + "," + getString(block) + ")";}
-	llvm::Value *Codegen() { 
-		/*
-			llvm::Value* ifVal = expr->Codegen();
-			llvm::BasicBlock* trueBB;
-			llvm::BasicBlock* entryBB = NULL;
-			llvm::BasicBlock* endBB = NULL;			
-			entryBB = llvm::BasicBlock::Create(TheContext, "whileentry",Builder.GetInsertBlock()->getParent());
-			trueBB = llvm::BasicBlock::Create(TheContext, "whiletrue",Builder.GetInsertBlock()->getParent());
-			endBB = llvm::BasicBlock::Create(TheContext, "whileend",Builder.GetInsertBlock()->getParent());
-			Builder.CreateBr(entryBB);
-			Builder.SetInsertPoint(entryBB);
-			ifVal = expr->Codegen();
-			Builder.CreateCondBr(ifVal, trueBB, endBB);
-			Builder.SetInsertPoint(trueBB);
-			block->Codegen();
-			Builder.CreateBr(entryBB);
-			Builder.SetInsertPoint(endBB);
-			return endBB;
-			*/
-		return 0;
-		}
 
 };
 
@@ -408,35 +655,38 @@ public:
 
 
 class AssignVarAST : public decafAST { 
-	string Name;
+	int Name;
 	decafAST* Expr;
 public:
-	AssignVarAST(string name, decafAST* expr): Name(name), Expr(expr) {}
-	~AssignVarAST() { if(Expr != NULL) { delete Expr; }}
-	string str() { return string("AssignVar") + "("+ Name + "," + getString(Expr) + ")" ;}
+	AssignVarAST(int name, decafAST* expr): Name(name), Expr(expr) {}
+	void print(astSink &out) { out << "AssignVar(" << idName(Name) << "," << Expr << ")"; }
+	bool assignParts(int &id, decafAST *&value) { id = Name; value = Expr; return true; }
+	bool assigns(int id) { return id == Name; }
 	llvm::Value* Codegen(){
-		llvm::AllocaInst* Alloca;
-		llvm::Value *val;
-		llvm::Value* tempVal;
-		llvm::Value* checkVal = access_symtbl(Name);
-		if(checkVal != NULL)
-			Alloca = (llvm::AllocaInst*)access_symtbl(Name);
-		else{
+		ssaVariable *local = access_local(Name);
+		llvm::Value *Global = local == NULL ? access_symtbl(Name) : NULL;
+		if (local == NULL && Global == NULL) {
 			throw runtime_error("assigning to non existent variable");
 		}
-		tempVal = Expr->Codegen();
-
-		//if(val == NULL){
-		//val = Builder.CreateAlloca(tempVal->getType(),0,Name.c_str());
-		val = Builder.CreateStore(tempVal, Alloca);
-		symtbl.front().insert(pair<string, descriptor*>(Name, val));
-//
-//		/}
-//		else{
-//			val = Builder.CreateStore(tempVal, Alloca);
-//		}
-		return val;
-
+		llvm::Value *val = Expr->Codegen();
+		if (local != NULL) {
+			// the value may have been computed in a later block than it started in
+			SSA.write(local, Builder->GetInsertBlock(), val);
+			return val;
+		}
+		return Builder->CreateStore(val, Global);
+	}
+	int Bytecode(vmCompiler &vc) {
+		vmSymbol *sym = vc.lookup(Name, idName(Name));
+		int r = Expr->Bytecode(vc);
+		if (sym->Kind == vmSymbol::LOCAL) {
+			vc.emit(VM_MOV, sym->Index, r);
+		} else if (sym->Kind == vmSymbol::GLOBAL) {
+			vc.emit(VM_STOREG, r, sym->Index);
+		} else {
+			throw runtime_error("assigning to non variable " + idName(Name));
+		}
+		return -1;
 	}
 };
 
@@ -446,27 +696,16 @@ class AssignArrayLocAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignArrayLocAST(decafAST* lval ,decafAST* expr): Lval(lval) ,Expr(expr) {}
-	~AssignArrayLocAST() { 
-		if(Expr != NULL) { delete Expr; }
-		if(Lval != NULL) { delete Lval; }
-	}
-	string str() { return string("AssignArrayLoc") + "("+ getString(Lval) +"," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignArrayLoc(" << Lval << "," << Expr << ")"; }
 	 llvm::Value *Codegen() { 	llvm::AllocaInst* Alloca;
 		llvm::Value* lVal = Lval->Codegen();
 		llvm::Value* rVal = Expr->Codegen();
 		if(lVal == NULL || rVal == NULL)
 			throw runtime_error("AssignArrayLoc error");
-		llvm::Value* storeVal= Builder.CreateStore(rVal,lVal); 
-		//if(val == NULL){
-		//val = Builder.CreateAlloca(tempVal->getType(),0,Name.c_str());
-		symtbl.front().insert(pair<string, descriptor*>(lVal->getName(), storeVal));
-//
-//		/}
-//		else{
-//			val = Builder.CreateStore(tempVal, Alloca);
-//		}
+		llvm::Value* storeVal= Builder->CreateStore(rVal,lVal); 
 		return storeVal;
 	}
+	int Bytecode(vmCompiler &vc);
 };
 
 
@@ -476,8 +715,9 @@ class MethodArgAST: public decafAST {
 public:
 	MethodArgAST(string value): Value(value) {}
 	string getValue() { return Value;}
-	string str() { return string("StringConstant") + "(" + Value + ")" ;}
-	llvm::Value* Codegen() {
+	void print(astSink &out) { out << "StringConstant(" << Value << ")"; }
+	// the string without quotes and with escapes resolved
+	string unescape() {
 		string temp = Value;
 		temp.erase(temp.begin());
 		temp.erase(temp.end()-1);
@@ -517,168 +757,566 @@ public:
     	while((found = temp.find("\\\\")) != std::string::npos) {
        		temp.replace(found, 2, "\\");
        	}
-		llvm::GlobalVariable *GS = Builder.CreateGlobalString(temp, "globalstring");
-		return Builder.CreateConstGEP2_32(GS->getValueType(),GS, 0, 0, "cast");
+		return temp;
+	}
+	llvm::Value* Codegen() {
+		llvm::GlobalVariable *GS = Builder->CreateGlobalString(unescape(), "globalstring");
+		return Builder->CreateConstGEP2_32(GS->getValueType(),GS, 0, 0, "cast");
+	}
+	int Bytecode(vmCompiler &vc) {
+		int t = vc.temp();
+		vc.emit(VM_CONST, t, vc.stringConstant(unescape()));
+		return t;
 	}
 };
 
 
 class VariableExprAST: public decafAST {
-	string Name;
+	int Name;
 public:
-	VariableExprAST(string name): Name(name) {}
-	string str() { return string("VariableExpr") + "(" + Name + ")" ;}
+	VariableExprAST(int name): Name(name) {}
+	void print(astSink &out) { out << "VariableExpr(" << idName(Name) << ")"; }
+	bool variableName(int &id) { id = Name; return true; }
+	bool isCheap(int depth) { return true; }
 	 llvm::Value *Codegen() { 
+	 	ssaVariable *local = access_local(Name);
+	 	if (local != NULL) {
+	 		return SSA.read(local, Builder->GetInsertBlock());
+	 	}
 	 	llvm::Value *V = access_symtbl(Name);
-	 //	if(V != NULL)
-	 		return Builder.CreateLoad(V, Name.c_str());
-	 	//throw runtime_error("Variable not called");
+	 	if (V == NULL) {
+	 		throw runtime_error("unknown variable " + idName(Name));
+	 	}
+	 	return Builder->CreateLoad(V, idName(Name).c_str());
 	 }
+	int Bytecode(vmCompiler &vc) {
+		vmSymbol *sym = vc.lookup(Name, idName(Name));
+		if (sym->Kind == vmSymbol::LOCAL) {
+			return sym->Index;
+		}
+		if (sym->Kind != vmSymbol::GLOBAL) {
+			throw runtime_error(idName(Name) + " is not a variable");
+		}
+		int t = vc.temp();
+		vc.emit(VM_LOADG, t, sym->Index);
+		return t;
+	}
 };
 
 
 
+// the function a failed bounds check calls, from decaf-stdlib.c
+llvm::Function *boundsErrorFunction() {
+	llvm::Function *F = TheModule->getFunction("decaf_bounds_error");
+	if (F == NULL) {
+		llvm::Type *args[] = { Builder->getInt32Ty(), Builder->getInt32Ty() };
+		llvm::FunctionType *FT = llvm::FunctionType::get(Builder->getVoidTy(), args, false);
+		F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "decaf_bounds_error", TheModule);
+		F->setDoesNotReturn();
+		F->addFnAttr(llvm::Attribute::Cold);
+	}
+	return F;
+}
+
+// loop-invariant proof that counter stays within [0, size) in the
+// body of the innermost counted loop over it, NULL if there is none.
+// Only a loop that is versioned can leave the proof to runtime.
+llvm::Value *counterFits(ssaVariable *counter, uint64_t size) {
+	for (vector<counterRange>::reverse_iterator r = rangeStack.rbegin(); r != rangeStack.rend(); ++r) {
+		if (r->counter != counter) {
+			continue;
+		}
+		if (!r->versioned && (!llvm::isa<llvm::Constant>(r->first) || !llvm::isa<llvm::Constant>(r->bound))) {
+			return NULL;
+		}
+		llvm::Value *&fits = r->fits[size];
+		if (fits == NULL) {
+			// computed once, before the loop is entered
+			llvm::IRBuilder<> pre(r->preheader->getTerminator());
+			llvm::Value *n = pre.getInt32(size);
+			switch (r->test) {
+			case OP_LT:
+				fits = pre.CreateAnd(pre.CreateICmpSGE(r->first, pre.getInt32(0)), pre.CreateICmpSLE(r->bound, n), "fits");
+				break;
+			case OP_LEQ:
+				fits = pre.CreateAnd(pre.CreateICmpSGE(r->first, pre.getInt32(0)), pre.CreateICmpSLT(r->bound, n), "fits");
+				break;
+			case OP_GT:
+				fits = pre.CreateAnd(pre.CreateICmpSGE(r->bound, pre.getInt32(-1)), pre.CreateICmpSLT(r->first, n), "fits");
+				break;
+			default:
+				fits = pre.CreateAnd(pre.CreateICmpSGE(r->bound, pre.getInt32(0)), pre.CreateICmpSLT(r->first, n), "fits");
+				break;
+			}
+			// counting up, the body sees at most size - 1 and the latch
+			// adds the step to it; if that can wrap around, the counter
+			// would come back into the body negative, so the bound must
+			// also keep the last step within i32
+			bool up = r->test == OP_LT || r->test == OP_LEQ;
+			if (up && (int64_t)size - 1 + r->step > INT32_MAX) {
+				int64_t most = (int64_t)INT32_MAX - r->step + (r->test == OP_LT ? 1 : 0);
+				fits = pre.CreateAnd(fits, pre.CreateICmpSLE(r->bound, pre.getInt32(most)), "fits");
+			}
+		}
+		return fits;
+	}
+	return NULL;
+}
+
+// trap unless 0 <= index < size. An index that is the counter of an
+// enclosing counted loop is not checked when the loop's start and bound
+// are constants within the array, nor when they are not known until
+// runtime: the loop then runs this unchecked body only after testing
+// its fits flags once, and a checked copy otherwise.
+void checkIndex(decafAST *Index, llvm::Value *index, uint64_t size) {
+	llvm::ConstantInt *c = llvm::dyn_cast<llvm::ConstantInt>(index);
+	if (c != NULL && c->getZExtValue() < size) {
+		return;
+	}
+	llvm::Value *fits = NULL;
+	int id;
+	if (Index->variableName(id)) {
+		fits = counterFits(access_local(id), size);
+	}
+	llvm::ConstantInt *known = llvm::dyn_cast_or_null<llvm::ConstantInt>(fits);
+	if (fits != NULL && (known == NULL || known->isOne())) {
+		return;
+	}
+	llvm::Function *F = Builder->GetInsertBlock()->getParent();
+	llvm::BasicBlock *okBB = llvm::BasicBlock::Create(*TheContext, "inbounds", F);
+	llvm::BasicBlock *failBB = llvm::BasicBlock::Create(*TheContext, "outofbounds", F);
+	llvm::Value *size32 = Builder->getInt32(size);
+	Builder->CreateCondBr(Builder->CreateICmpULT(index, size32), okBB, failBB);
+	SSA.seal(okBB);
+	SSA.seal(failBB);
+	Builder->SetInsertPoint(failBB);
+	Builder->CreateCall(boundsErrorFunction(), { index, size32 });
+	Builder->CreateUnreachable();
+	Builder->SetInsertPoint(okBB);
+}
+
+// address of element Index of the global array Name
+llvm::Value *arrayElement(int Name, decafAST *Index) {
+	llvm::GlobalVariable* array = (llvm::GlobalVariable*)access_symtbl(Name);
+	if (array == NULL) {
+		throw runtime_error("unknown array " + idName(Name));
+	}
+	llvm::ArrayType *arrayT = (llvm::ArrayType*)(array-> getValueType());
+	llvm::Value *ArrayLoc = Builder->CreateStructGEP(arrayT, array, 0, "arrayloc");
+	llvm::Value *index = Index->Codegen();
+	if (!index->getType()->isIntegerTy(32)) {
+		throw runtime_error("array index must be an int");
+	}
+	if (TheCompiler->options.boundsChecks) {
+		checkIndex(Index, index, arrayT->getNumElements());
+	}
+	return Builder->CreateGEP(arrayT->getElementType(), ArrayLoc, index, "arrayindex");
+}
+
 class ArrayLocExprAST : public decafAST { 
-	string Name;
+	int Name;
 	decafAST* Index;
 public:
-	ArrayLocExprAST(string name, decafAST* index): Name(name), Index(index) {}
-	~ArrayLocExprAST() { if(Index != NULL) { delete Index; }}
-	string str() { return string("ArrayLocExpr") + "("+ Name + "," + getString(Index) + ")" ;}
+	ArrayLocExprAST(int name, decafAST* index): Name(name), Index(index) {}
+	void print(astSink &out) { out << "ArrayLocExpr(" << idName(Name) << "," << Index << ")"; }
 	llvm::Value *Codegen() { 
-		llvm::GlobalVariable* array = (llvm::GlobalVariable*)access_symtbl(Name);
-		llvm::ArrayType *arrayT = (llvm::ArrayType*)(array-> getValueType());
-		llvm::Value *ArrayLoc = Builder.CreateStructGEP(arrayT, array, 0, "arrayloc");
-		llvm::Value *index = Builder.getInt32(atoi(Index->str().c_str())); 	
-		llvm::Value *ArrayIndex = Builder.CreateGEP(arrayT->getElementType(), ArrayLoc, index, "arrayindex");
-		return ArrayIndex;
+		llvm::Value *ArrayIndex = arrayElement(Name, Index);
+		return Builder->CreateLoad(ArrayIndex, "arrayval");
+	}
+	int Bytecode(vmCompiler &vc) {
+		vmSymbol *sym = vc.lookup(Name, idName(Name));
+		if (sym->Kind != vmSymbol::ARRAY) {
+			throw runtime_error(idName(Name) + " is not an array");
+		}
+		int i = Index->Bytecode(vc);
+		int t = vc.temp();
+		vc.emit(VM_LOADA, t, sym->Index, i);
+		return t;
 	}
 };
 
  
 class ArrayLValAST : public decafAST { 
-	string Name;
+	int Name;
 	decafAST* Index;
 public:
-	ArrayLValAST(string name, decafAST* index): Name(name), Index(index) {}
-	~ArrayLValAST() { if(Index != NULL) { delete Index; }}
-	string str() { return string( Name + "," + getString(Index) ) ;}
+	ArrayLValAST(int name, decafAST* index): Name(name), Index(index) {}
+	void print(astSink &out) { out << idName(Name) << "," << Index; }
 	 llvm::Value *Codegen() { 		
-	 	llvm::GlobalVariable* array = (llvm::GlobalVariable*)access_symtbl(Name);
-		llvm::ArrayType *arrayT = (llvm::ArrayType*)(array-> getValueType());
-		llvm::Value *ArrayLoc = Builder.CreateStructGEP(arrayT, array, 0, "arrayloc");
-		llvm::Value *index = Builder.getInt32(atoi(Index->str().c_str())); 	
-		llvm::Value *ArrayIndex = Builder.CreateGEP(arrayT->getElementType(), ArrayLoc, index, "arrayindex");
-		return ArrayIndex;
+		return arrayElement(Name, Index);
+	}
+	// store value into the element, the index is evaluated first
+	void storeBytecode(vmCompiler &vc, decafAST *value) {
+		vmSymbol *sym = vc.lookup(Name, idName(Name));
+		if (sym->Kind != vmSymbol::ARRAY) {
+			throw runtime_error(idName(Name) + " is not an array");
+		}
+		int i = Index->Bytecode(vc);
+		vc.emit(VM_STOREA, value->Bytecode(vc), sym->Index, i);
 	}
 };
 
+/// isCounted - is this for (i = a; i < b; i = i + c) with a constant step?
+/// The test may be any comparison of the counter against a bound.
+bool ForStmtAST::isCounted(int &counter, int32_t &step, decafOp &test, decafAST *&bound) {
+	int id;
+	decafOp op;
+	decafAST *left, *value;
+	if (loop_assign->size() != 1 || !loop_assign->lastElement()->assignParts(counter, value)) {
+		return false;
+	}
+	if (!value->binaryParts(op, left, bound) || (op != OP_PLUS && op != OP_MINUS)
+		|| !left->variableName(id) || id != counter || !bound->constantValue(step)) {
+		return false;
+	}
+	if (op == OP_MINUS) {
+		if (step == INT32_MIN) {
+			return false;
+		}
+		step = -step;
+	}
+	if (!expr->binaryParts(test, left, bound) || test < OP_LT || test > OP_NEQ) {
+		return false;
+	}
+	return left->variableName(id) && id == counter;
+}
+
+/// pushRange - record the counter's range for checkIndex if the body
+/// cannot move it: a local counter the body never assigns, stepping
+/// towards an invariant bound, with the loop running while it is short
+/// of it. Constant starts and bounds are used as constants; others only
+/// in a loop with no for loop inside, the one that gets versioned.
+bool ForStmtAST::pushRange(int counter, int32_t step, decafOp test, decafAST *bound, llvm::BasicBlock *preheader) {
+	ssaVariable *counterVar = access_local(counter);
+	bool up = (test == OP_LT || test == OP_LEQ) && step > 0;
+	bool down = (test == OP_GT || test == OP_GEQ) && step < 0;
+	if ((!up && !down) || counterVar == NULL || block->assigns(counter)) {
+		return false;
+	}
+	llvm::IRBuilder<> pre(preheader->getTerminator());
+	llvm::Value *boundV;
+	int32_t c;
+	int id;
+	if (bound->constantValue(c)) {
+		boundV = pre.getInt32(c);
+	} else if (bound->variableName(id) && id != counter && access_local(id) != NULL && !block->assigns(id)) {
+		boundV = SSA.read(access_local(id), preheader);
+	} else {
+		return false;
+	}
+	llvm::Value *first = NULL;
+	llvm::ArrayRef<decafAST *> pres = pre_assign_list->returnList();
+	for (size_t i = 0; i < pres.size(); i++) {
+		decafAST *value;
+		if (pres[i]->assignParts(id, value) && id == counter) {
+			first = value->constantValue(c) ? pre.getInt32(c) : NULL;
+		}
+	}
+	if (first == NULL) {
+		first = SSA.read(counterVar, preheader);
+	}
+	counterRange r = { counterVar, first, boundV, test, step, preheader, !block->containsFor(), map<uint64_t, llvm::Value *>() };
+	rangeStack.push_back(r);
+	return true;
+}
+
+/// rotatedLoop - the body at bodyBB and a latch that steps the counter
+/// and either goes round again or leaves through exitBB.
+void ForStmtAST::rotatedLoop(llvm::BasicBlock *bodyBB, llvm::BasicBlock *exitBB) {
+	llvm::Function *F = bodyBB->getParent();
+	llvm::BasicBlock *latchBB = llvm::BasicBlock::Create(*TheContext, "forlatch", F);
+	Builder->SetInsertPoint(bodyBB);
+	loopTargets targets = { latchBB, exitBB };
+	loopStack.push_back(targets);
+	block->Codegen();
+	loopStack.pop_back();
+	Builder->CreateBr(latchBB);
+	SSA.seal(latchBB);
+	Builder->SetInsertPoint(latchBB);
+	loop_assign->Codegen();
+	Builder->CreateCondBr(expr->Codegen(), bodyBB, exitBB);
+	SSA.seal(bodyBB);
+}
 
+/// Codegen - a counted loop is emitted rotated, in the form the loop
+/// passes expect: a guard, a preheader, the body as the header, and a
+/// latch that steps the counter and tests again, with a dedicated exit.
+/// Other for loops test at the top.
+llvm::Value *ForStmtAST::Codegen() {
+	llvm::Function *F = Builder->GetInsertBlock()->getParent();
+	pre_assign_list->Codegen();
+	int counter;
+	int32_t step;
+	decafOp test;
+	decafAST *bound;
+	if (isCounted(counter, step, test, bound)) {
+		llvm::BasicBlock *preheaderBB = llvm::BasicBlock::Create(*TheContext, "forpreheader", F);
+		llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(*TheContext, "forbody", F);
+		llvm::BasicBlock *exitBB = llvm::BasicBlock::Create(*TheContext, "forexit", F);
+		llvm::BasicBlock *endBB = llvm::BasicBlock::Create(*TheContext, "forend", F);
+		Builder->CreateCondBr(expr->Codegen(), preheaderBB, endBB);
+		SSA.seal(preheaderBB);
+		Builder->SetInsertPoint(preheaderBB);
+		Builder->CreateBr(bodyBB);
+		size_t ranges = rangeStack.size();
+		bool ranged = TheCompiler->options.boundsChecks && pushRange(counter, step, test, bound, preheaderBB);
+		rotatedLoop(bodyBB, exitBB);
+		llvm::Value *fast = NULL;
+		if (ranged) {
+			map<uint64_t, llvm::Value *> &fits = rangeStack.back().fits;
+			llvm::IRBuilder<> pre(preheaderBB->getTerminator());
+			for (map<uint64_t, llvm::Value *>::iterator i = fits.begin(); i != fits.end(); ++i) {
+				if (!llvm::isa<llvm::Constant>(i->second)) {
+					fast = fast == NULL ? i->second : pre.CreateAnd(fast, i->second, "fits");
+				}
+			}
+		}
+		rangeStack.resize(ranges);
+		if (fast != NULL) {
+			// the unchecked loop only runs when it stays in bounds
+			// throughout, otherwise a copy with every check runs
+			llvm::BasicBlock *fastBB = llvm::BasicBlock::Create(*TheContext, "forfast", F);
+			llvm::BasicBlock *checkedBB = llvm::BasicBlock::Create(*TheContext, "forchecked", F);
+			llvm::BasicBlock *checkedBodyBB = llvm::BasicBlock::Create(*TheContext, "forbody", F);
+			preheaderBB->getTerminator()->eraseFromParent();
+			Builder->SetInsertPoint(preheaderBB);
+			Builder->CreateCondBr(fast, fastBB, checkedBB);
+			SSA.seal(fastBB);
+			SSA.seal(checkedBB);
+			Builder->SetInsertPoint(fastBB);
+			Builder->CreateBr(bodyBB);
+			// the body was sealed while it was entered from the preheader
+			for (llvm::BasicBlock::iterator i = bodyBB->begin(); llvm::isa<llvm::PHINode>(i); ++i) {
+				llvm::PHINode *phi = llvm::cast<llvm::PHINode>(i);
+				phi->setIncomingBlock(phi->getBasicBlockIndex(preheaderBB), fastBB);
+			}
+			Builder->SetInsertPoint(checkedBB);
+			Builder->CreateBr(checkedBodyBB);
+			rotatedLoop(checkedBodyBB, exitBB);
+		}
+		SSA.seal(exitBB);
+		Builder->SetInsertPoint(exitBB);
+		Builder->CreateBr(endBB);
+		SSA.seal(endBB);
+		Builder->SetInsertPoint(endBB);
+		return endBB;
+	}
+	llvm::BasicBlock *condBB = llvm::BasicBlock::Create(*TheContext, "forcond", F);
+	llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(*TheContext, "forbody", F);
+	llvm::BasicBlock *nextBB = llvm::BasicBlock::Create(*TheContext, "fornext", F);
+	llvm::BasicBlock *endBB = llvm::BasicBlock::Create(*TheContext, "forend", F);
+	Builder->CreateBr(condBB);
+	Builder->SetInsertPoint(condBB);
+	Builder->CreateCondBr(expr->Codegen(), bodyBB, endBB);
+	SSA.seal(bodyBB);
+	Builder->SetInsertPoint(bodyBB);
+	loopTargets targets = { nextBB, endBB };
+	loopStack.push_back(targets);
+	block->Codegen();
+	loopStack.pop_back();
+	Builder->CreateBr(nextBB);
+	SSA.seal(nextBB);
+	Builder->SetInsertPoint(nextBB);
+	loop_assign->Codegen();
+	Builder->CreateBr(condBB);
+	SSA.seal(condBB);
+	SSA.seal(endBB);
+	Builder->SetInsertPoint(endBB);
+	return endBB;
+}
 
+int AssignArrayLocAST::Bytecode(vmCompiler &vc) {
+	((ArrayLValAST *)Lval)->storeBytecode(vc, Expr);
+	return -1;
+}
 
 
 
+
+
+
+// the value of an integer literal, decimal or 0x hex, wrapping to 32 bits
+int32_t intLiteral(const string &text) {
+	if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+		return (int32_t)strtoul(text.c_str() + 2, NULL, 16);
+	}
+	return (int32_t)strtoul(text.c_str(), NULL, 10);
+}
+
 class NumberExprAST: public decafAST {
 	string Value;
 public:
 	NumberExprAST(string value): Value(value) {}
-	string str() { return string("NumberExpr") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "NumberExpr(" << Value << ")"; }
+	int32_t intValue() { return intLiteral(Value); }
 	llvm::Value* Codegen(){
-		return Builder.getInt32(stoi(Value));
+		return Builder->getInt32(intValue());
+	}
+	int Bytecode(vmCompiler &vc) {
+		int t = vc.temp();
+		vc.emit(VM_CONST, t, intValue());
+		return t;
 	}
+	bool constantValue(int32_t &v) { v = intValue(); return true; }
+	bool isCheap(int depth) { return true; }
 };
 
 
 class BoolExprAST: public decafAST {
-	string Value;
+	bool Value;
 public:
-	BoolExprAST(string value): Value(value) {}
-	string str() { return string("BoolExpr") + "(" + Value + ")" ;}
+	BoolExprAST(bool value): Value(value) {}
+	void print(astSink &out) { out << "BoolExpr(" << (Value ? "True" : "False") << ")"; }
 	llvm::Value* Codegen(){
-		if(Value == "True")
-			return Builder.getInt1(1);
-		else if(Value == "False")
-			return Builder.getInt1(0);
-		else
-			throw runtime_error("BoolExpr error");
+		return Builder->getInt1(Value);
 	}
+	int Bytecode(vmCompiler &vc) {
+		int t = vc.temp();
+		vc.emit(VM_CONST, t, Value);
+		return t;
+	}
+	bool constantValue(int32_t &v) { v = Value; return true; }
+	bool isCheap(int depth) { return true; }
 };
 
 //BinaryExpr(binary_operator op, expr left_value, expr right_value)
 
 class BinaryExprAST : public decafAST { 
-	string Op;
+	decafOp Op;
 	decafAST* Left;
 	decafAST* Right;
 public:
-	BinaryExprAST(string op,decafAST* left ,decafAST* right): Op(op), Left(left) , Right(right) {}
-	~BinaryExprAST() { 
-		if(Left != NULL) { delete Left; }
-		if(Right != NULL) { delete Right; }
+	BinaryExprAST(decafOp op,decafAST* left ,decafAST* right): Op(op), Left(left) , Right(right) {}
+	void print(astSink &out) { out << "BinaryExpr(" << opName(Op) << "," << Left << "," << Right << ")"; }
+	bool binaryParts(decafOp &op, decafAST *&left, decafAST *&right) { op = Op; left = Left; right = Right; return true; }
+	bool isCheap(int depth) {
+		return depth < cheapDepth && Op != OP_DIV && Op != OP_MOD
+			&& Left->isCheap(depth + 1) && Right->isCheap(depth + 1);
+	}
+	// Left && Right or Left || Right, the right side only runs if the left
+	// does not decide the result
+	llvm::Value *shortCircuit() {
+		llvm::Value *L = Left->Codegen();
+		llvm::BasicBlock *leftBB = Builder->GetInsertBlock();
+		llvm::Function *F = leftBB->getParent();
+		llvm::BasicBlock *rightBB = llvm::BasicBlock::Create(*TheContext, Op == OP_AND ? "andrhs" : "orrhs", F);
+		llvm::BasicBlock *endBB = llvm::BasicBlock::Create(*TheContext, Op == OP_AND ? "andend" : "orend", F);
+		if (Op == OP_AND) {
+			Builder->CreateCondBr(L, rightBB, endBB);
+		} else {
+			Builder->CreateCondBr(L, endBB, rightBB);
+		}
+		SSA.seal(rightBB);
+		Builder->SetInsertPoint(rightBB);
+		llvm::Value *R = Right->Codegen();
+		rightBB = Builder->GetInsertBlock();
+		Builder->CreateBr(endBB);
+		SSA.seal(endBB);
+		Builder->SetInsertPoint(endBB);
+		llvm::PHINode *val = Builder->CreatePHI(Builder->getInt1Ty(), 2, Op == OP_AND ? "andtmp" : "ortmp");
+		val->addIncoming(Builder->getInt1(Op == OP_OR), leftBB);
+		val->addIncoming(R, rightBB);
+		return val;
 	}
-	string str() { return string("BinaryExpr") + "("+ Op + "," + getString(Left) +"," + getString(Right) + ")" ;}
 	llvm::Value *Codegen() {
+	  // cheap right operands are evaluated anyway, without a branch
+	  if ((Op == OP_AND || Op == OP_OR) && !Right->isCheap()) {
+	    return shortCircuit();
+	  }
 	  llvm::Value *L = Left->Codegen();
 	  llvm::Value *R = Right->Codegen();
 	  if (L == 0 || R == 0) return 0;
 	  if( L->getType() != R->getType() && (L->getType()->isIntegerTy() && R->getType()->isIntegerTy())){
-	  	llvm::Value *promo = Builder.CreateZExt(L, Builder.getInt32Ty(), "zexttmp");
+	  	llvm::Value *promo = Builder->CreateZExt(L, Builder->getInt32Ty(), "zexttmp");
      	L = promo;
-     	llvm::Value *promo1 = Builder.CreateZExt(R, Builder.getInt32Ty(), "zexttmp");
+     	llvm::Value *promo1 = Builder->CreateZExt(R, Builder->getInt32Ty(), "zexttmp");
      	R = promo1;
 	  }
 	  
-	  if(Op == "Minus")
-	  	return Builder.CreateSub(L, R, "subtmp");
-	  else if(Op == "Plus")
-	  	return Builder.CreateAdd(L, R, "addtmp");
-	  else if(Op == "Mult")
-	  	return Builder.CreateMul(L, R, "multmp");
-	  else if(Op == "Div")
-	  	return Builder.CreateSDiv(L, R, "sdivtmp");
-	  else if(Op == "Mod")
-	  	return Builder.CreateSRem(L, R, "sremtmp");
-	  else if(Op == "Leftshift")
-	  	return Builder.CreateShl(L, R, "shltmp");
-	  else if(Op == "Rightshift")
-	  	return Builder.CreateLShr(L, R, "lshrtmp");
-	  else if(Op == "Lt")
-	  	return Builder.CreateICmpSLT(L, R, "cmpslttmp");
-	  else if(Op == "Leq")
-	  	return Builder.CreateICmpSLE(L, R, "cmpsletmp");
-	  else if(Op == "Gt")
-	  	return Builder.CreateICmpSGT(L, R, "cmpsgttmp");
-	  else if(Op == "Geq")
-	  	return Builder.CreateICmpSGE(L, R, "cmpsgetmp");
-	  else if(Op == "And")
-	  	return Builder.CreateAnd(L, R, "andtmp");
-	  else if(Op == "Or")
-	  	return Builder.CreateOr(L, R, "ortmp");
-	  else if(Op == "Eq")
-	  	return Builder.CreateICmpEQ(L, R, "cmpeqtmp");
-	  else if(Op == "Neq")
-	  	return Builder.CreateICmpNE(L, R, "cmpnetmp");
+	  switch (Op) {
+	  case OP_MINUS: return Builder->CreateSub(L, R, "subtmp");
+	  case OP_PLUS: return Builder->CreateAdd(L, R, "addtmp");
+	  case OP_MULT: return Builder->CreateMul(L, R, "multmp");
+	  case OP_DIV: return Builder->CreateSDiv(L, R, "sdivtmp");
+	  case OP_MOD: return Builder->CreateSRem(L, R, "sremtmp");
+	  // the shift amount is taken mod 32, as the VM does: a raw shl or lshr
+	  // by 32 or more is poison, and isCheap lets it run unguarded
+	  case OP_LEFTSHIFT: return Builder->CreateShl(L, Builder->CreateAnd(R, 31), "shltmp");
+	  case OP_RIGHTSHIFT: return Builder->CreateLShr(L, Builder->CreateAnd(R, 31), "lshrtmp");
+	  case OP_LT: return Builder->CreateICmpSLT(L, R, "cmpslttmp");
+	  case OP_LEQ: return Builder->CreateICmpSLE(L, R, "cmpsletmp");
+	  case OP_GT: return Builder->CreateICmpSGT(L, R, "cmpsgttmp");
+	  case OP_GEQ: return Builder->CreateICmpSGE(L, R, "cmpsgetmp");
+	  case OP_AND: return Builder->CreateAnd(L, R, "andtmp");
+	  case OP_OR: return Builder->CreateOr(L, R, "ortmp");
+	  case OP_EQ: return Builder->CreateICmpEQ(L, R, "cmpeqtmp");
+	  case OP_NEQ: return Builder->CreateICmpNE(L, R, "cmpnetmp");
+	  default: break;
+	  }
 	  throw runtime_error("binary expr fault");
 	}
+	int Bytecode(vmCompiler &vc) {
+		int t = vc.temp();
+		if (Op == OP_AND || Op == OP_OR) {
+			// the right operand only runs if it decides the result
+			vc.emit(VM_MOV, t, Left->Bytecode(vc));
+			int skip = vc.emit(Op == OP_AND ? VM_JZ : VM_JNZ, t);
+			vc.emit(VM_MOV, t, Right->Bytecode(vc));
+			vc.patch(skip, vc.here());
+			return t;
+		}
+		int L = Left->Bytecode(vc);
+		int R = Right->Bytecode(vc);
+		vmOpcode op;
+		switch (Op) {
+		case OP_PLUS: op = VM_ADD; break;
+		case OP_MINUS: op = VM_SUB; break;
+		case OP_MULT: op = VM_MUL; break;
+		case OP_DIV: op = VM_DIV; break;
+		case OP_MOD: op = VM_MOD; break;
+		case OP_LEFTSHIFT: op = VM_SHL; break;
+		case OP_RIGHTSHIFT: op = VM_SHR; break;
+		case OP_LT: op = VM_LT; break;
+		case OP_LEQ: op = VM_LEQ; break;
+		case OP_GT: op = VM_GT; break;
+		case OP_GEQ: op = VM_GEQ; break;
+		case OP_EQ: op = VM_EQ; break;
+		case OP_NEQ: op = VM_NEQ; break;
+		default: throw runtime_error("binary expr fault");
+		}
+		vc.emit(op, t, L, R);
+		return t;
+	}
 };
 
 
 
 class UnaryExprAST : public decafAST { 
-	string Op;
+	decafOp Op;
 	decafAST* Value;
 public:
-	UnaryExprAST(string op, decafAST* value): Op(op), Value(value) {}
-	~UnaryExprAST() { if(Value != NULL) { delete Value; }}
-	string str() { return string("UnaryExpr") + "("+ Op + "," + getString(Value) + ")" ;}
+	UnaryExprAST(decafOp op, decafAST* value): Op(op), Value(value) {}
+	void print(astSink &out) { out << "UnaryExpr(" << opName(Op) << "," << Value << ")"; }
+	bool isCheap(int depth) { return depth < cheapDepth && Value->isCheap(depth + 1); }
 	llvm::Value* Codegen(){
 		llvm::Value *V = Value->Codegen();
-		if(Op == "UnaryMinus")
-	  		return Builder.CreateNeg(V, "negtmp");
-	  	else if(Op == "Not")
-	  		return Builder.CreateNot(V, "nottmp");
+		switch (Op) {
+		case OP_UNARYMINUS: return Builder->CreateNeg(V, "negtmp");
+		case OP_NOT: return Builder->CreateNot(V, "nottmp");
+		default: break;
+		}
 	  	throw runtime_error("unary expr fault");
 	}
+	int Bytecode(vmCompiler &vc) {
+		int v = Value->Bytecode(vc);
+		int t = vc.temp();
+		switch (Op) {
+		case OP_UNARYMINUS: vc.emit(VM_NEG, t, v); return t;
+		case OP_NOT: vc.emit(VM_NOT, t, v); return t;
+		default: break;
+		}
+		throw runtime_error("unary expr fault");
+	}
 };
 
 
@@ -687,14 +1325,10 @@ class MethodBlockAST : public decafAST {
 	decafStmtList *statement_list;
 public:
 	MethodBlockAST(decafStmtList* vList, decafStmtList* sList): varDefList(vList), statement_list(sList) {} 
-	~MethodBlockAST(){ 
-		if(varDefList != NULL) {delete varDefList;}
-		if(statement_list != NULL) {delete statement_list;}
-	}
-	string str() { return string("MethodBlock") + "(" + getString(varDefList) + "," + getString(statement_list) + ")"; }
+	void print(astSink &out) { out << "MethodBlock(" << varDefList << "," << statement_list << ")"; }
 	llvm::Value* Codegen(){
 		llvm::Value *val = NULL;
-		llvm::Function *func= Builder.GetInsertBlock()->getParent();
+		llvm::Function *func= Builder->GetInsertBlock()->getParent();
 		llvm::Function::arg_iterator iter = func -> arg_begin();
 		/*
 		while(iter != func->arg_end()){
@@ -702,9 +1336,9 @@ public:
 			llvm::Type* iterType = (iter)->getType();
 			llvm::AllocaInst* Alloca;
 			val = access_symtbl(iterName);
-			Alloca = Builder.CreateAlloca(iterType,0,iterName.c_str());
-			val = Builder.CreateStore(val, Alloca);
-			symtbl.front().insert(pair<string, descriptor*>(iterName, val));
+			Alloca = Builder->CreateAlloca(iterType,0,iterName.c_str());
+			val = Builder->CreateStore(val, Alloca);
+			symtbl.insert(iterName, val);
 			iter++;
 
 		}
@@ -718,95 +1352,126 @@ public:
 
 		return val;
 	}
+	int Bytecode(vmCompiler &vc) {
+		varDefList->Bytecode(vc);
+		statement_list->stmtBytecode(vc);
+		return -1;
+	}
 
 };
 
 //Method(identifier name, method_type return_type, typed_symbol* param_list, method_block block)
 class MethodDeclAST: public decafAST {
-	string Name;
+	int Name;
 	decafStmtList* DecVarList;
-	string MType;
+	decafType MType;
 	decafAST* MBlock;
 public:
-	MethodDeclAST(string name, decafStmtList* list, string type, decafAST* block ) : Name(name), DecVarList(list), MType(type), MBlock(block) {}
-	~MethodDeclAST(){ 
-		if(DecVarList != NULL) {delete DecVarList;}
-		if(MBlock != NULL) {delete MBlock;}
+	MethodDeclAST(int name, decafStmtList* list, decafType type, decafAST* block ) : Name(name), DecVarList(list), MType(type), MBlock(block) {}
+	int returnName() { return Name;}
+	void print(astSink &out) { out << "Method(" << idName(Name) << "," << typeName(MType) << "," << DecVarList << "," << MBlock << ")"; }
+	// the function in the current module, declared on first use so that
+	// calls can go forward and a module per method needs no other bodies
+	llvm::Function *prototype() {
+		if (llvm::Function *func = TheModule->getFunction(idName(Name))) {
+			return func;
+		}
+		llvm::FunctionType *FT;
+		if (Name == TheCompiler->mainId) {
+			FT = llvm::FunctionType::get(llvm::IntegerType::get(*TheContext, 32), false);
+		} else {
+			FT = llvm::FunctionType::get(getLLVMType(MType), DecVarList->returnArgs(), false);
+		}
+		llvm::Function *func = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, idName(Name), TheModule);
+		llvm::ArrayRef<decafAST *> argList = DecVarList->returnList();
+		llvm::Function::arg_iterator iter = func->arg_begin();
+		for (llvm::ArrayRef<decafAST *>::iterator i = argList.begin(); i != argList.end() && iter != func->arg_end(); i++) {
+			iter->setName(idName(((VarDefAST*)(*i))->returnName()));
+			iter++;
+		}
+		return func;
 	}
-	string str() { return string("Method") + "("+ Name + "," + MType + "," + getString(DecVarList) + "," + getString(MBlock)+ ")"; }
+	llvm::Value *Declare() { return prototype(); }
 	llvm::Value *Codegen(){
-		llvm::Type *returnTy= getLLVMType(MType);
-		llvm::Function *func = NULL;
-		vector<llvm::Type *> args = DecVarList->returnArgs();
-		if(Name == "main"){
-			llvm::FunctionType *FT = llvm::FunctionType::get(llvm::IntegerType::get(TheContext, 32), false);
-			TheFunction = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "main", TheModule);
-			symtbl.front().insert(pair<string,descriptor*>("main", (llvm::Value*) TheFunction));
-			if (TheFunction == 0) {
-				throw runtime_error("empty function block"); 
-			}
-			// Create a new basic block which contains a sequence of LLVM instructions
-			llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, "entry", TheFunction);
-			// All subsequent calls to IRBuilder will place instructions in this location
-			Builder.SetInsertPoint(BB);
-		}
-		else{
-			func= llvm::Function::Create(llvm::FunctionType::get(returnTy, args, false),llvm::Function::ExternalLinkage,Name,TheModule);
-			list<decafAST *> argList = DecVarList->returnList();
-			llvm::Function::arg_iterator iter = func -> arg_begin();
-			for (list<decafAST *>::iterator i = argList.begin(); i != argList.end(); i++) { 
-				iter->setName(((VarDefAST*)(*i))->returnName());
-				iter++;
-			}
-
-			symtbl.front().insert(pair<string,descriptor*>(Name, func));
-			llvm::BasicBlock*BB = llvm::BasicBlock::Create(TheContext, "entry", func);
-			Builder.SetInsertPoint(BB);
-			symtbl.front().insert(pair<string, descriptor*>(string("entry"),(llvm::Value*) BB));
-			iter = func -> arg_begin();
-			for (list<decafAST *>::iterator i = argList.begin(); i != argList.end(); i++) { 
-				llvm::AllocaInst*Alloca= Builder.CreateAlloca(getLLVMType(((VarDefAST*)(*i))->returnType()), nullptr, string(iter->getName()).c_str());// Store the initial value into the alloca.
-				Builder.CreateStore(static_cast<llvm::Value *>(&*iter), Alloca);// Add to symbol table
-				symtbl.front().insert(pair<string, descriptor*>(iter->getName(), Alloca));
-				iter++;
-			}
+		llvm::Function *func = prototype();
+		TheFunction = func;
+		// parameters and method locals live in their own scope, undone on return
+		symtbl.push_scope();
+		localtbl.push_scope();
+		// Create a new basic block which contains a sequence of LLVM instructions
+		llvm::BasicBlock *BB = llvm::BasicBlock::Create(*TheContext, "entry", func);
+		// All subsequent calls to IRBuilder will place instructions in this location
+		Builder->SetInsertPoint(BB);
+		SSA.startFunction();
+		SSA.seal(BB);
+		llvm::ArrayRef<decafAST *> argList = DecVarList->returnList();
+		llvm::Function::arg_iterator iter = func->arg_begin();
+		for (llvm::ArrayRef<decafAST *>::iterator i = argList.begin(); i != argList.end() && iter != func->arg_end(); i++) {
+			// a parameter starts out as the incoming argument
+			ssaVariable *var = SSA.declare(iter->getType(), string(iter->getName()));
+			localtbl.insert(((VarDefAST*)(*i))->returnName(), var);
+			SSA.write(var, BB, &*iter);
+			iter++;
 		}
-		symbol_table MblocTable;
-		symtbl.push_front(MblocTable);
-		llvm::Value* temp =MBlock->Codegen();
-		if(MType == "BoolType" )
-			Builder.CreateRet(Builder.getInt1(0));
-		if(MType == "IntType" )
-			Builder.CreateRet(Builder.getInt32(0));
-		if(MType == "VoidType")
-			Builder.CreateRetVoid();
-		symtbl.pop_front();
+		MBlock->Codegen();
+		if(MType == TY_VOID)
+			Builder->CreateRetVoid();
+		else
+			Builder->CreateRet(getZeroInit(MType));
+		localtbl.pop_scope();
+		symtbl.pop_scope();
 		return func;
 	}
+	// the function itself was declared by PackageAST so calls can be forward
+	int Bytecode(vmCompiler &vc) {
+		int index = vc.lookup(Name, idName(Name))->Index;
+		vmFunction *f = &vc.prog.functions[index];
+		if (Name == TheCompiler->mainId) {
+			vc.prog.mainIndex = index;
+		}
+		vc.beginFunction(f);
+		llvm::ArrayRef<decafAST *> params = DecVarList->returnList();
+		for (llvm::ArrayRef<decafAST *>::iterator i = params.begin(); i != params.end(); i++) {
+			vc.bind(((VarDefAST *)(*i))->returnName(), vmSymbol::LOCAL, vc.local());
+		}
+		f->nparams = params.size();
+		MBlock->Bytecode(vc);
+		vc.endFunction();
+		return -1;
+	}
 };
 
+// a method of the package or an extern
+llvm::Function *calleeFunction(int Name) {
+	if (MethodDeclAST *m = methodDecls.lookup(Name)) {
+		return m->prototype();
+	}
+	llvm::Function *F = llvm::dyn_cast_or_null<llvm::Function>(access_symtbl(Name));
+	if (F == NULL) {
+		throw runtime_error("unknown method " + idName(Name));
+	}
+	return F;
+}
+
 class MethodCallAST	: public decafAST {
-	string Name;
+	int Name;
 	decafStmtList *method_arg_list;
 public:
-	MethodCallAST(string name, decafStmtList *mArgList): Name(name), method_arg_list(mArgList) {}
-	~MethodCallAST() { 
-		if (method_arg_list != NULL) { delete method_arg_list; }
-	}
-	string str() { 
-		return string("MethodCall") + "(" + Name + "," + getString(method_arg_list) + ")";
+	MethodCallAST(int name, decafStmtList *mArgList): Name(name), method_arg_list(mArgList) {}
+	void print(astSink &out) {
+		out << "MethodCall(" << idName(Name) << "," << method_arg_list << ")";
 	}
 	llvm::Value* Codegen(){
 
 
-		llvm::Function *call= (llvm::Function*)access_symtbl(Name);
+		llvm::Function *call = calleeFunction(Name);
 		// assign this to the pointer to the function to call, 
 		// usually loaded from the symbol table
 		vector<llvm::Value *> args = method_arg_list->returnArgsV();
 		llvm::Argument* iter = call->arg_begin();
 		for (vector<llvm::Value *>::iterator i = args.begin(); i != args.end(); i++) { 
      		if(((*i)->getType() != iter ->getType())&& (*i)->getType()->isIntegerTy() == true){
-     			llvm::Value *promo = Builder.CreateZExt(*i, Builder.getInt32Ty(), "zexttmp");
+     			llvm::Value *promo = Builder->CreateZExt(*i, Builder->getInt32Ty(), "zexttmp");
      			*i = promo;
      		}
        		iter++;
@@ -815,7 +1480,7 @@ public:
 		// e.g. foo(1) would have a vector of size one with value of 1 with type i32.
 
 		bool isVoid = call->getReturnType()->isVoidTy();
-		llvm::Value *val = Builder.CreateCall(
+		llvm::Value *val = Builder->CreateCall(
 		    call,
 		    args,
 		    isVoid ? "" : "calltmp"
@@ -823,24 +1488,59 @@ public:
 
 		return val;
 	}
+	int Bytecode(vmCompiler &vc) {
+		vmSymbol *sym = vc.lookup(Name, idName(Name));
+		llvm::ArrayRef<decafAST *> argList = method_arg_list->returnList();
+		vector<int> args;
+		for (llvm::ArrayRef<decafAST *>::iterator i = argList.begin(); i != argList.end(); i++) {
+			args.push_back((*i)->Bytecode(vc));
+		}
+		int t = vc.temp();
+		if (sym->Kind == vmSymbol::BUILTIN) {
+			if (sym->Index < 0) {
+				throw runtime_error("extern " + idName(Name) + " is not available in the bytecode VM");
+			}
+			if (sym->Index == VM_READI) {
+				vc.emit(VM_READI, t);
+			} else {
+				if (args.size() != 1) {
+					throw runtime_error("wrong number of arguments to " + idName(Name));
+				}
+				vc.emit(sym->Index, args[0]);
+			}
+			return t;
+		}
+		if (sym->Kind != vmSymbol::FUNCTION) {
+			throw runtime_error(idName(Name) + " is not a method");
+		}
+		// the callee's parameters are copied from consecutive registers
+		int base = t + 1;
+		for (size_t i = 0; i < args.size(); i++) {
+			vc.emit(VM_MOV, vc.temp(), args[i]);
+		}
+		vc.emit(VM_CALL, t, sym->Index, base);
+		return t;
+	}
 };
 
 class ParenExprAST: public decafAST {
 	decafAST* Value;
 public:
 	ParenExprAST(decafAST* value): Value(value) {}
-	string str() { return "(" + getString(Value) + ")" ;}
+	void print(astSink &out) { out << "(" << Value << ")"; }
 	 llvm::Value *Codegen() { return Value->Codegen();}
+	int Bytecode(vmCompiler &vc) { return Value->Bytecode(vc); }
+	bool isCheap(int depth) { return depth < cheapDepth && Value->isCheap(depth + 1); }
 };
 
 // VarDef(StringType) | VarDef(decaf_type)
 class ExternTypeAST : public decafAST {
-	string Name;
+	decafType Type;
 public:
-	ExternTypeAST(string name): Name(name) {}
-	string str() { return string("VarDef") + "(" + Name + ")" ;}
+	ExternTypeAST(decafType type): Type(type) {}
+	void print(astSink &out) { out << "VarDef(" << typeName(Type) << ")"; }
 	 llvm::Value *Codegen() { 
-	 	return (llvm::Value*)getLLVMType(Name);
+	 	return (llvm::Value*)getLLVMType(Type);
 	}
 };
 
@@ -849,67 +1549,80 @@ public:
 
 
 class ExternFunctionAST : public decafAST {
-	string Name;
-	string ReturnType;
+	int Name;
+	decafType ReturnType;
 	decafAST* InputType;
 public:
-	ExternFunctionAST(string name, string returnType, decafAST* inputType): Name(name), ReturnType(returnType), InputType(inputType) {}
-	~ExternFunctionAST() { if(InputType != NULL) {delete InputType;}}
-	string str() { return string("ExternFunction") + "(" + Name + "," + ReturnType + "," + getString(InputType) + ")" ;}
+	ExternFunctionAST(int name, decafType returnType, decafAST* inputType): Name(name), ReturnType(returnType), InputType(inputType) {}
+	void print(astSink &out) { out << "ExternFunction(" << idName(Name) << "," << typeName(ReturnType) << "," << InputType << ")"; }
 	 llvm::Value *Codegen() { 
 	 	llvm::Type *returnTy = getLLVMType(ReturnType);
 	 	vector<llvm::Type *> args = ((decafStmtList*)InputType)->returnArgsE();
-	 	llvm::Function* val = llvm::Function::Create(llvm::FunctionType::get(returnTy, args, false), llvm::Function::ExternalLinkage, Name, TheModule);
-	 	symtbl.front().insert(pair<string,descriptor*>(Name, val));
+	 	llvm::Function* val = llvm::Function::Create(llvm::FunctionType::get(returnTy, args, false), llvm::Function::ExternalLinkage, idName(Name), TheModule);
+	 	symtbl.insert(Name, val);
 	 	return val;
 	 }
+	// the VM implements the decaf-stdlib.c functions itself
+	int Bytecode(vmCompiler &vc) {
+		const string &name = idName(Name);
+		if (name == "print_int") {
+			vc.bind(Name, vmSymbol::BUILTIN, VM_PRINTI);
+		} else if (name == "print_string") {
+			vc.bind(Name, vmSymbol::BUILTIN, VM_PRINTS);
+		} else if (name == "read_int") {
+			vc.bind(Name, vmSymbol::BUILTIN, VM_READI);
+		} else {
+			// only an error if it is actually called
+			vc.bind(Name, vmSymbol::BUILTIN, -1);
+		}
+		return -1;
+	}
 };
 
 
 //FieldDecl(identifier name, decaf_type type, field_size size)
 
 class ArrayAST: public decafAST {
-	string ArrSize;
+	string ArrSize;   // as written, for the printed AST
+	int32_t Size;
 public:
-	ArrayAST(string arrSize): ArrSize(arrSize) {}
-	string str() { return string("Array") + "(" + ArrSize + ")" ;}
-	string retSize(){return ArrSize;}
+	ArrayAST(string arrSize, int32_t size): ArrSize(arrSize), Size(size) {}
+	void print(astSink &out) { out << "Array(" << ArrSize << ")"; }
+	int32_t size() { return Size; }
 	llvm::Value *Codegen() { return 0;}
 };
 
 
+class IdAST: public decafAST {
+	int Name;
+public:
+	IdAST(int name): Name(name) {}
+	int returnId() { return Name;}
+	void print(astSink &out) { out << idName(Name); }
+	llvm::Value *Codegen() { throw runtime_error("idast");}
+};
+
+
 class FieldDeclAST : public decafAST {
-	decafAST* Name;
-	string Type;
+	IdAST* Name;
+	decafType Type;
 	decafAST* FSize;
+	bool Scalar;
+	int32_t Size;   // elements of an array, resolved by the parser
 
 public:
-	FieldDeclAST(decafAST* name, string type, decafAST* fSize): Name(name), Type(type), FSize(fSize) {}
-	~FieldDeclAST() {
-		if(Name != NULL) {delete Name;}
-	}
-	string returnType() { return Type;}
-	string returnArr() { return FSize->str();}
-	string str() {return string("FieldDecl") + "(" + getString(Name) + "," + Type + "," + FSize->str() + ")" ;}
+	FieldDeclAST(IdAST* name, decafType type, decafAST* fSize, bool scalar, int32_t size = 0): Name(name), Type(type), FSize(fSize), Scalar(scalar), Size(size) {}
+	decafType returnType() { return Type;}
+	decafAST* returnArr() { return FSize;}
+	int32_t arraySize() { return Size; }
+	void print(astSink &out) { out << "FieldDecl(" << Name << "," << typeName(Type) << "," << FSize << ")"; }
 	llvm::Value *Codegen() {
-		if(FSize->str() != "Scalar")
+		if (!Scalar)
 		{
-			llvm::ArrayType *array;
-			if(Type == "IntType")
-			{
-				array = llvm::ArrayType::get(Builder.getInt32Ty(), atoi((((ArrayAST*)(FSize))->retSize()).c_str()));
-			}
-			else if(Type == "BoolType")
-			{
-				array = llvm::ArrayType::get(Builder.getInt1Ty(), atoi((((ArrayAST*)(FSize))->retSize()).c_str()));
-			}
-			else if(Type == "StringType")
-			{
-				array = llvm::ArrayType::get(Builder.getInt8PtrTy(), atoi((((ArrayAST*)(FSize))->retSize()).c_str()));
-			}
+			llvm::ArrayType *array = llvm::ArrayType::get(getLLVMType(Type), Size);
 			llvm::Constant *zeroInit = llvm::Constant::getNullValue(array);
 			llvm::GlobalVariable *Foo = new llvm::GlobalVariable(*TheModule, array, false, llvm::GlobalValue::ExternalLinkage, zeroInit, Name->str());
-			symtbl.front().insert(pair<string,descriptor*>(Name->str(), Foo));
+			symtbl.insert(Name->returnId(), Foo);
 			return Foo;
 		}
 		else{
@@ -921,11 +1634,33 @@ public:
 			    getZeroInit(Type), 
 			    Name->str()
     		);
-    		symtbl.front().insert(pair<string,descriptor*>(Name->str(), Foo));
+    		symtbl.insert(Name->returnId(), Foo);
 			return Foo;
  		}
 		//throw runtime_error("FieldDecl");
 	}
+	llvm::Value *Declare() {
+		llvm::Type *type = getLLVMType(Type);
+		if (!Scalar) {
+			type = llvm::ArrayType::get(type, Size);
+		}
+		llvm::GlobalVariable *Foo = new llvm::GlobalVariable(*TheModule, type, false, llvm::GlobalValue::ExternalLinkage, NULL, Name->str());
+		symtbl.insert(Name->returnId(), Foo);
+		return Foo;
+	}
+	int Bytecode(vmCompiler &vc) {
+		vmProgram &prog = vc.prog;
+		if (!Scalar) {
+			vmArray arr = { (int)prog.globalInit.size(), Size };
+			prog.globalInit.resize(arr.base + arr.size, 0);
+			prog.arrays.push_back(arr);
+			vc.bind(Name->returnId(), vmSymbol::ARRAY, prog.arrays.size() - 1);
+		} else {
+			prog.globalInit.push_back(0);
+			vc.bind(Name->returnId(), vmSymbol::GLOBAL, prog.globalInit.size() - 1);
+		}
+		return -1;
+	}
 
 };
 
@@ -937,35 +1672,276 @@ public:
 class ScalarAST: public decafAST {
 public:
 	ScalarAST() {}
-	string str() {return string("Scalar");}
+	void print(astSink &out) { out << "Scalar"; }
 	llvm::Value *Codegen() { throw runtime_error("scalar");}
 
 };
 
 //AssignGlobalVar(identifier name, decaf_type type, expr value)
-//TO BE FIXED
 class AssignGlobalVarAST : public decafAST {
-	string Name;
-	string Type;
+	int Name;
+	decafType Type;
 	decafAST* Expr;
 public:
-	AssignGlobalVarAST(string name, string type, decafAST* expr): Name(name), Type(type), Expr(expr) {}
-	~AssignGlobalVarAST() {if(Expr != NULL) {delete Expr;}}
-	string str() {return string("AssignGlobalVar") + "(" + Name + "," + Type + "," + getString(Expr) + ")" ;}
+	AssignGlobalVarAST(int name, decafType type, decafAST* expr): Name(name), Type(type), Expr(expr) {}
+	void print(astSink &out) { out << "AssignGlobalVar(" << idName(Name) << "," << typeName(Type) << "," << Expr << ")"; }
+	// the initializer is folded the same way Bytecode does it, so both
+	// backends start from the same value
+	int32_t initValue() {
+		int32_t v = 0;
+		if (Expr != NULL && !Expr->constantValue(v)) {
+			throw runtime_error("global initializer is not a constant");
+		}
+		return v;
+	}
 	 llvm::Value *Codegen() { 
 	 	llvm::GlobalVariable *Foo = new llvm::GlobalVariable(
 		    *TheModule, 
 		    getLLVMType(Type), 
 		    false,  // variable is mutable
 		    llvm::GlobalValue::InternalLinkage, 
-		    getZeroInit(Type), 
-		    Name
+		    llvm::ConstantInt::get(getLLVMType(Type), initValue()), 
+		    idName(Name)
 		);
-		symtbl.front().insert(pair<string,descriptor*>(Name, Foo));
+		symtbl.insert(Name, Foo);
 		return Foo;
 	}
+	llvm::Value *Declare() {
+		llvm::GlobalVariable *Foo = new llvm::GlobalVariable(*TheModule, getLLVMType(Type), false, llvm::GlobalValue::ExternalLinkage, NULL, idName(Name));
+		symtbl.insert(Name, Foo);
+		return Foo;
+	}
+	int Bytecode(vmCompiler &vc) {
+		vc.prog.globalInit.push_back(initValue());
+		vc.bind(Name, vmSymbol::GLOBAL, vc.prog.globalInit.size() - 1);
+		return -1;
+	}
 };
 
+// every method is declared before any body is compiled so calls can go
+// forward
+void PackageAST::declareMethods() {
+	llvm::ArrayRef<decafAST *> methods = MethodDeclList->returnList();
+	for (llvm::ArrayRef<decafAST *>::iterator i = methods.begin(); i != methods.end(); i++) {
+		MethodDeclAST *m = (MethodDeclAST *)(*i);
+		methodDecls[m->returnName()] = m;
+		m->prototype();
+	}
+}
+
+llvm::Value *PackageAST::Codegen() {
+	llvm::Value *val = NULL;
+	if (NULL != FieldDeclList) {
+		val = FieldDeclList->Codegen();
+	}
+	if (NULL != MethodDeclList) {
+		declareMethods();
+		val = MethodDeclList->Codegen();
+	}
+	// Q: should we enter the class name into the symbol table?
+	return val;
+}
+
+// the type a method's module expects a function or global it uses to have
+static string declarationType(llvm::GlobalValue *G) {
+	string type;
+	llvm::raw_string_ostream os(type);
+	G->getValueType()->print(os);
+	return os.str();
+}
+
+// one method in a module of its own on the calling thread's context,
+// written out as bitcode for the main thread to link. deps lists the
+// functions and globals the method uses, one "name\ttype" per line; the
+// runtime's own functions are fixed by the compiler and left out.
+static void methodModule(MethodDeclAST *m, decafStmtList *externs, decafStmtList *fields, llvm::SmallVectorImpl<char> &bitcode, string &deps) {
+	TheModule = new llvm::Module(idName(m->returnName()), *TheContext);
+	symtbl.push_scope();
+	try {
+		if (NULL != externs) {
+			externs->Codegen();
+		}
+		if (NULL != fields) {
+			fields->Declare();
+		}
+		m->Codegen();
+		optimizeModule(TheModule, TheCompiler->options.optLevel);
+	}
+	catch (...) {
+		symtbl.pop_scope();
+		delete TheModule;
+		throw;
+	}
+	symtbl.pop_scope();
+	for (llvm::GlobalValue &G : TheModule->global_values()) {
+		if (G.isDeclaration() && !G.use_empty() && !G.getName().startswith("llvm.") && G.getName() != "decaf_bounds_error") {
+			deps += G.getName().str() + "\t" + declarationType(&G) + "\n";
+		}
+	}
+	llvm::raw_svector_ostream out(bitcode);
+	llvm::WriteBitcodeToFile(*TheModule, out);
+	delete TheModule;
+	TheModule = NULL;
+}
+
+// can the cached code of a method be linked into this compilation? Every
+// function and global it uses must still be declared with the same type.
+static bool depsMatch(llvm::StringRef deps) {
+	while (!deps.empty()) {
+		pair<llvm::StringRef, llvm::StringRef> line = deps.split('\n');
+		pair<llvm::StringRef, llvm::StringRef> dep = line.first.split('\t');
+		llvm::GlobalValue *G = TheModule->getNamedValue(dep.first);
+		if (G == NULL || declarationType(G) != dep.second) {
+			return false;
+		}
+		deps = line.second;
+	}
+	return true;
+}
+
+// -j<N>: the globals and all prototypes go into this thread's module,
+// then N threads generate and optimize one method at a time in their own
+// context. The main thread links the results in source order, so the
+// output does not depend on which thread finished first. Each method is
+// optimized on its own, calls between methods are not inlined.
+// --incremental: a method whose printed AST is in the cache, and whose
+// callees and globals kept their types, is linked from the cached
+// bitcode; only the others are generated and then added to the cache.
+llvm::Value *PackageAST::parallelCodegen(decafStmtList *externs) {
+	if (NULL != FieldDeclList) {
+		FieldDeclList->Codegen();
+	}
+	if (NULL == MethodDeclList) {
+		return NULL;
+	}
+	declareMethods();
+	llvm::ArrayRef<decafAST *> methods = MethodDeclList->returnList();
+	// the workers only find the target registry filled
+	initializeHostTarget();
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	vector<llvm::SmallVector<char, 0> > bitcode(methods.size());
+	vector<string> errors(methods.size());
+	vector<string> deps(methods.size());
+	CompilerInstance *ci = TheCompiler;
+	// the cache entry of a method is its deps, an empty line and its bitcode
+	vector<string> keys;
+	vector<size_t> todo;
+	if (ci->options.incremental && ci->cache) {
+		string flags = ci->codegenFlags() + " method";
+		string entry;
+		for (size_t i = 0; i < methods.size(); i++) {
+			keys.push_back(compileCache::key(getString(methods[i]), flags));
+			size_t sep;
+			if (ci->cache->fetch(keys[i], entry) && (sep = entry.find("\n\n")) != string::npos
+					&& depsMatch(llvm::StringRef(entry.data(), sep + 1))) {
+				bitcode[i].append(entry.begin() + sep + 2, entry.end());
+			} else {
+				todo.push_back(i);
+			}
+		}
+	} else {
+		for (size_t i = 0; i < methods.size(); i++) {
+			todo.push_back(i);
+		}
+	}
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	const llvm::DenseMap<int, MethodDeclAST *> &decls = methodDecls;
+	for (unsigned t = 0; t < ci->options.codegenJobs && t < todo.size(); t++) {
+		workers.push_back(thread([&]() {
+			llvm::LLVMContext context;
+			context.setDiscardValueNames(ci->options.releaseMode);
+			llvm::IRBuilder<> builder(context);
+			beginCodegen(ci, &context, &builder, NULL);
+			methodDecls = decls;
+			for (size_t n = next++; n < todo.size(); n = next++) {
+				size_t i = todo[n];
+				try {
+					methodModule((MethodDeclAST *)methods[i], externs, FieldDeclList, bitcode[i], deps[i]);
+				}
+				catch (std::runtime_error &e) {
+					errors[i] = e.what();
+				}
+			}
+			endCodegen();
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++) {
+		workers[t].join();
+	}
+	for (size_t i = 0; i < methods.size(); i++) {
+		if (!errors[i].empty()) {
+			throw runtime_error(errors[i]);
+		}
+	}
+	if (!keys.empty()) {
+		for (size_t n = 0; n < todo.size(); n++) {
+			size_t i = todo[n];
+			ci->cache->store(keys[i], deps[i] + "\n" + string(bitcode[i].data(), bitcode[i].size()));
+		}
+	}
+
+	// the workers refer to the globals by name, internal ones would not
+	// be matched up by the linker
+	vector<llvm::GlobalVariable *> internal;
+	for (llvm::GlobalVariable &G : TheModule->globals()) {
+		if (G.hasInternalLinkage()) {
+			G.setLinkage(llvm::GlobalValue::ExternalLinkage);
+			internal.push_back(&G);
+		}
+	}
+	// one linker for all of them, it scans the module once
+	llvm::Linker linker(*TheModule);
+	for (size_t i = 0; i < methods.size(); i++) {
+		llvm::MemoryBufferRef buffer(llvm::StringRef(bitcode[i].data(), bitcode[i].size()), idName(((MethodDeclAST *)methods[i])->returnName()));
+		llvm::Expected<unique_ptr<llvm::Module> > M = llvm::parseBitcodeFile(buffer, *TheContext);
+		if (!M) {
+			throw runtime_error("cannot read back method " + buffer.getBufferIdentifier().str() + ": " + llvm::toString(M.takeError()));
+		}
+		if (TheModule->getTargetTriple().empty()) {
+			TheModule->setTargetTriple((*M)->getTargetTriple());
+			TheModule->setDataLayout((*M)->getDataLayout());
+		}
+		if (linker.linkInModule(std::move(*M))) {
+			throw runtime_error("cannot link method " + buffer.getBufferIdentifier().str());
+		}
+		bitcode[i].clear();
+	}
+	for (size_t i = 0; i < internal.size(); i++) {
+		internal[i]->setLinkage(llvm::GlobalValue::InternalLinkage);
+	}
+	if (ci->options.printStats) {
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		ci->err << "codegen: " << methods.size() << " methods on " << workers.size() << " threads in " << elapsed.count() << " ms";
+		if (!keys.empty()) {
+			ci->err << ", " << methods.size() - todo.size() << " reused";
+		}
+		ci->err << endl;
+	}
+	return NULL;
+}
+
+// globals first, then every method is declared before any body is
+// compiled so calls can go forward
+int PackageAST::Bytecode(vmCompiler &vc) {
+	if (NULL != FieldDeclList) {
+		FieldDeclList->Bytecode(vc);
+	}
+	if (NULL != MethodDeclList) {
+		llvm::ArrayRef<decafAST *> methods = MethodDeclList->returnList();
+		for (llvm::ArrayRef<decafAST *>::iterator i = methods.begin(); i != methods.end(); i++) {
+			MethodDeclAST *m = (MethodDeclAST *)(*i);
+			vc.prog.functions.push_back(vmFunction());
+			vc.prog.functions.back().name = idName(m->returnName());
+			vc.prog.functions.back().index = vc.prog.functions.size() - 1;
+			vc.bind(m->returnName(), vmSymbol::FUNCTION, vc.prog.functions.size() - 1);
+		}
+		MethodDeclList->Bytecode(vc);
+	}
+	return -1;
+}
+
 
 //Method(identifier name, method_type return_type, typed_symbol* param_list, method_block block)
 /*
@@ -975,16 +1951,7 @@ class MethodAST : public decafAST {
 	decafAST* MBlock;
 public:
 	MethodAST(string name, string type, decafAST* mBlock): Name(name), Type(Type), MBlock(mBlock) {}
-	~MethodAST() {if(MBlock != NULL) {delete MBlock;}}
 	string str() {return string("FieldDecl") + "(" + Name + "," + Type + "," + getString(MBlock) + ")" ;}
 };
 */
 
-class IdAST: public decafAST {
-	string Name;
-public:
-	IdAST(string name): Name(name) {}
-	string str() {return Name;}
-	llvm::Value *Codegen() { throw runtime_error("idast");}
-};
-
@@ -3,17 +3,20 @@
 #include <ostream>
 #include <string>
 #include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <thread>
 #include "default-defs.h"
+#include "decaf-opt.h"
+#include "decaf-emit.h"
+#include "decaf-jit.h"
+#include "decaf-vm.h"
+#include "decaf-tier.h"
+#include "decaf-compiler.h"
+#include "llvm/Support/raw_os_ostream.h"
 
 #define YYDEBUG 1
 
-
-int yylex(void);
-int yyerror(char *); 
-
-// print AST?
-bool printAST = false;
-
 using namespace std;
 
 
@@ -23,27 +26,85 @@ typedef llvm::Value descriptor;
 
 #include "decafcomp.cc"
 
-llvm::Function *gen_main_def() {
-  // create the top-level definition for main
-  llvm::FunctionType *FT = llvm::FunctionType::get(Builder.getVoidTy(), false);
-  llvm::Function *TheFunction = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "WillNeverBeUsed", TheModule);
-  symtbl.front().insert(pair<string,descriptor*>("WillNeverBeUsed", (llvm::Value*) TheFunction));
-  if (TheFunction == 0) {
-    throw runtime_error("empty function block"); 
-  }
-  // Create a new basic block which contains a sequence of LLVM instructions
-  llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, "entry", TheFunction);
-  // All subsequent calls to IRBuilder will place instructions in this location
-  Builder.SetInsertPoint(BB);
-//  Builder.CreateRet(llvm::ConstantInt::get(TheContext, llvm::APInt(32, 0)));
-  return TheFunction;
+// one step of --stream: generate d, or only declare it when it is a
+// method found ahead of the parse
+static void streamStep(decafAST *d, bool declare) {
+  if (declare) {
+    MethodDeclAST *m = (MethodDeclAST *)d;
+    symtbl.insert(m->returnName(), m->Declare());
+  } else {
+    d->Codegen();
+  }
+}
+
+// --pipeline: end the code generation thread's stream and wait for it;
+// false, after reporting it, if it hit a semantic error
+static bool finishCodegen(CompilerInstance *ci) {
+  codegenPipe *pipe = ci->pipe.get();
+  if (!pipe->worker.joinable()) {
+    return !pipe->failed.load();
+  }
+  codegenItem end = { NULL, false };
+  pipe->items.push(end);
+  pipe->worker.join();
+  if (pipe->failed.load()) {
+    ci->out << "semantic error: " << pipe->error << endl;
+    ci->semanticError = true;
+    return false;
+  }
+  return true;
+}
+
+// code generation from a parser action, for --stream; false after a
+// semantic error, on which the action aborts the parse. With --pipeline
+// the step is queued for the code generation thread, and the error is
+// only seen by the actions that follow it.
+static bool streamCodegen(CompilerInstance *ci, decafAST *d, bool declare = false) {
+  if (ci->options.pipelined()) {
+    if (ci->pipe->failed.load(memory_order_relaxed)) {
+      return finishCodegen(ci);
+    }
+    codegenItem item = { d, declare };
+    ci->pipe->items.push(item);
+    return true;
+  }
+  try {
+    streamStep(d, declare);
+  }
+  catch (std::runtime_error &e) {
+    ci->out << "semantic error: " << e.what() << endl;
+    ci->semanticError = true;
+    return false;
+  }
+  return true;
 }
 
 %}
 
+// reentrant: the parser's state is on the stack of yyparse, the scanner's
+// in its yyscan_t, everything else in the CompilerInstance
+%define api.pure full
+%lex-param {CompilerInstance *ci} {void *scanner}
+%parse-param {CompilerInstance *ci} {void *scanner}
+
+%code requires {
+class CompilerInstance;
+}
+
+%code provides {
+// scanner is the flex scanner, or with --pipeline the tokenPipe from the
+// scanning thread; lexerNext reads the flex scanner
+int yylex(YYSTYPE *lvalp, CompilerInstance *ci, void *scanner);
+int lexerNext(YYSTYPE *lvalp, void *scanner);
+int yyerror(CompilerInstance *ci, void *scanner, const char *s);
+}
+
 %union{
     class decafAST *ast;
-    std::string *sval;
+    tokenText tok;
+    int id;
+    decafOp op;
+    decafType ty;
  }
 
 %token T_BOOLTYPE
@@ -90,15 +151,16 @@ llvm::Function *gen_main_def() {
 %token T_AND
 %token T_OR
 %token T_DOT
-%token <sval> T_ID
+%token <id> T_ID
 
-%token <sval> T_INTCONSTANT
-%token <sval> T_CHARCONSTANT
-%token <sval> T_STRINGCONSTANT
+%token <tok> T_INTCONSTANT
+%token <tok> T_CHARCONSTANT
+%token <tok> T_STRINGCONSTANT
 
 //%token T_COMMENT
 
-%type <sval> decaf_type method_type unaryNot unaryMinus boolAnd boolOr boolRest arithRest plusMinus
+%type <ty> decaf_type method_type
+%type <op> unaryNot unaryMinus boolAnd boolOr boolRest arithRest plusMinus
 
 
 %type <ast> extern_list extern externR block var-decl-list var-decl extern_type extern_typeR const bool_const assign assignR expr method_call method-arg-list method-arg statements statement method-dec-list method-dec arrayType dec-var-struct dec-var-structR decafpackage field-decR field-dec mBlock mul-field-decR mul-arr-decR id_list_var expr1 expr2 expr3 expr4 expr5 expr6 expr7 lvalue
@@ -111,21 +173,42 @@ llvm::Function *gen_main_def() {
 start: program
 
 
-program: extern_list decafpackage
+program: extern_list
+    {
+        if (ci->options.streamMethods() && !streamCodegen(ci, $1)) {
+            YYABORT;
+        }
+    }
+    decafpackage
     { 
-        ProgramAST *prog = new ProgramAST((decafStmtList *)$1, (PackageAST *)$2); 
-		if (printAST) {
-			cout << getString(prog) << endl;
+        ProgramAST *prog = new ProgramAST((decafStmtList *)$1, (PackageAST *)$3); 
+		if (ci->options.printAST) {
+			astSink out(ci->out);
+			out << prog << "\n";
+		}
+		// the code generation thread still reads the tree, it goes with
+		// the arena below
+		if (ci->options.pipelined() && !finishCodegen(ci)) {
+			YYABORT;
 		}
 		try {
-            prog->Codegen();
+            if (ci->options.useVM) {
+                vmCompiler vc(ci->bytecode, ci->identifiers);
+                prog->Bytecode(vc);
+            } else if (!ci->options.streamMethods()) {
+                prog->Codegen();
+            }
         } 
         catch (std::runtime_error &e) {
-            cout << "semantic error: " << e.what() << endl;
+            ci->out << "semantic error: " << e.what() << endl;
             //cout << prog->str() << endl; 
-            exit(EXIT_FAILURE);
+            ci->semanticError = true;
+            YYABORT;
         }
-        delete prog;
+        if (ci->options.printStats) {
+            ci->arena.printStats(ci->err);
+        }
+        ci->arena.reset();
     }
 
 extern_list: externR
@@ -136,8 +219,23 @@ extern_list: externR
     { decafStmtList *slist = new decafStmtList(); $$ = slist; }
     ;
 
-decafpackage: T_PACKAGE T_ID T_LCB field-decR method-dec-list T_RCB
-    { $$ = new PackageAST(*$2, (decafStmtList*)$4, (decafStmtList*)$5); delete $2; }
+decafpackage: T_PACKAGE T_ID T_LCB field-decR
+    {
+        // the methods are generated one by one as they are reduced
+        if (ci->options.streamMethods()) {
+            if (!streamCodegen(ci, $4)) {
+                YYABORT;
+            }
+            for (size_t i = 0; i < ci->streamPrototypes.size(); i++) {
+                if (!streamCodegen(ci, ci->streamPrototypes[i], true)) {
+                    YYABORT;
+                }
+            }
+            ci->streamMark = ci->arena.mark();
+        }
+    }
+    method-dec-list T_RCB
+    { $$ = new PackageAST($2, (decafStmtList*)$4, (decafStmtList*)$6); }
     ;
 
 block : T_LCB var-decl-list statements T_RCB {$$ = new BlockAST((decafStmtList *)$2, (decafStmtList *)$3);}
@@ -160,29 +258,28 @@ var-decl: T_VAR id_list_var T_SEMICOLON { $$ = $2;}
 id_list_var: T_ID T_COMMA id_list_var {
 		decafStmtList *slist = (decafStmtList*) $3;
 		VarDefAST* last = (VarDefAST*) (slist -> lastElement());
-		string type = last -> returnType();
-		$$ = new VarDefAST(*$1,type);
+		decafType type = last -> returnType();
+		$$ = new VarDefAST($1,type);
 		slist -> push_front($$);
 		$$ = slist;
 	}
-	| T_ID decaf_type { decafStmtList *slist = new decafStmtList(); $$ = new VarDefAST(*$1,*$2); slist -> push_front($$); $$ = slist; delete $1; delete $2;}
+	| T_ID decaf_type { decafStmtList *slist = new decafStmtList(); $$ = new VarDefAST($1,$2); slist -> push_front($$); $$ = slist;}
 	;
 
 
-decaf_type: T_INTTYPE {$$ = new std::string("IntType");}
-	| T_BOOLTYPE	{$$ = new std::string("BoolType");}
+decaf_type: T_INTTYPE {$$ = TY_INT;}
+	| T_BOOLTYPE	{$$ = TY_BOOL;}
 	;
 
-method_type: T_VOID {$$ = new std::string("VoidType");}
+method_type: T_VOID {$$ = TY_VOID;}
 	| decaf_type	{$$ = $1;}
 	;
 
 extern_type: T_STRINGTYPE 
 	{ 
-		std::string temp = "StringType";
-		$$ = new ExternTypeAST(temp); 
+		$$ = new ExternTypeAST(TY_STRING); 
 	}
-	| decaf_type { $$ = new ExternTypeAST(*$1) ; delete $1;}
+	| decaf_type { $$ = new ExternTypeAST($1) ;}
 	;
 
 extern_typeR: extern_type T_COMMA extern_typeR  
@@ -201,10 +298,10 @@ extern_typeR: extern_type T_COMMA extern_typeR
 	;
 
 
-const: T_INTCONSTANT {$$ = new NumberExprAST(*$1); delete $1;}
+const: T_INTCONSTANT {$$ = new NumberExprAST($1.str());}
 	| T_CHARCONSTANT 
 	{
-		std::string str = *$1;
+		std::string str = $1.str();
 		char *c = new char();
 		*c = str[1];
 		int temp = int(*c);
@@ -261,13 +358,12 @@ const: T_INTCONSTANT {$$ = new NumberExprAST(*$1); delete $1;}
 		str = std::to_string(temp);
 		delete c;
 		$$ = new NumberExprAST(str);
-		delete $1;
 	}
 	| bool_const	 {$$ = $1;}
 	;
 
-bool_const: T_TRUE {$$ = new BoolExprAST("True");}
-	| T_FALSE	{$$ = new BoolExprAST("False");}
+bool_const: T_TRUE {$$ = new BoolExprAST(true);}
+	| T_FALSE	{$$ = new BoolExprAST(false);}
 	;
 
 assignR: assign assignR
@@ -281,81 +377,81 @@ assignR: assign assignR
 
 assign: T_ID T_ASSIGN expr 
 	{
-		$$ = new AssignVarAST(*$1,$3); delete $1;
+		$$ = new AssignVarAST($1,$3);
 	}
 	| lvalue T_ASSIGN expr { $$ = new AssignArrayLocAST($1,$3);}
 	;
 
-lvalue: T_ID T_LSB expr T_RSB { $$ = new ArrayLValAST(*$1,$3); delete $1;}	
+lvalue: T_ID T_LSB expr T_RSB { $$ = new ArrayLValAST($1,$3);}	
 
 
 
- expr : expr boolOr expr1  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+ expr : expr boolOr expr1  { $$ = new BinaryExprAST($2,$1,$3);}
 	| expr1
 	;
 
-expr1 : expr1 boolAnd expr2  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr1 : expr1 boolAnd expr2  { $$ = new BinaryExprAST($2,$1,$3);}
 	| expr2
 	;
 
-expr2 : expr2 boolRest expr3  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr2 : expr2 boolRest expr3  { $$ = new BinaryExprAST($2,$1,$3);}
 	| expr3
 	;
 
-expr3 : expr3 plusMinus expr4  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr3 : expr3 plusMinus expr4  { $$ = new BinaryExprAST($2,$1,$3);}
 	| expr4
 	;
 
-expr4 : expr4 arithRest expr5  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr4 : expr4 arithRest expr5  { $$ = new BinaryExprAST($2,$1,$3);}
 	| expr5
 	;
 
-expr5 : unaryNot expr5  { $$ = new UnaryExprAST(*$1,$2), delete $1;}
-	| unaryNot expr6  { $$ = new UnaryExprAST(*$1,$2), delete $1;}
+expr5 : unaryNot expr5  { $$ = new UnaryExprAST($1,$2);}
+	| unaryNot expr6  { $$ = new UnaryExprAST($1,$2);}
 	| expr6
 	;
 
-expr6 : unaryMinus expr6  { $$ = new UnaryExprAST(*$1,$2), delete $1;} 
-	| unaryMinus expr7  { $$ = new UnaryExprAST(*$1,$2), delete $1;}
+expr6 : unaryMinus expr6  { $$ = new UnaryExprAST($1,$2);} 
+	| unaryMinus expr7  { $$ = new UnaryExprAST($1,$2);}
 	| expr7
 	;
 
-expr7 : T_ID T_LSB expr T_RSB { $$ = new ArrayLocExprAST(*$1,$3); delete $1;}
-	| T_ID {$$ = new VariableExprAST(*$1); delete $1; }
+expr7 : T_ID T_LSB expr T_RSB { $$ = new ArrayLocExprAST($1,$3);}
+	| T_ID {$$ = new VariableExprAST($1); }
 	| const {$$ = $1;}
 	| T_LPAREN expr T_RPAREN { $$ = $2;}
 	| method_call {$$ = $1;}
 	;
 
-unaryNot: T_NOT {$$ = new std::string("Not");}
+unaryNot: T_NOT {$$ = OP_NOT;}
 
-unaryMinus: T_MINUS {$$ = new std::string("UnaryMinus");}
+unaryMinus: T_MINUS {$$ = OP_UNARYMINUS;}
 
-arithRest : T_MULT	{$$ = new std::string("Mult");}
-	| T_DIV		{$$ = new std::string("Div");}
-	| T_MOD		{$$ = new std::string("Mod");}
-	| T_LBW		{$$ = new std::string("Leftshift");}
-	| T_RBW		{$$ = new std::string("Rightshift");}
+arithRest : T_MULT	{$$ = OP_MULT;}
+	| T_DIV		{$$ = OP_DIV;}
+	| T_MOD		{$$ = OP_MOD;}
+	| T_LBW		{$$ = OP_LEFTSHIFT;}
+	| T_RBW		{$$ = OP_RIGHTSHIFT;}
 	;
 
-plusMinus : T_PLUS {$$ = new std::string("Plus");}
-	| T_MINUS	{$$ = new std::string("Minus");}
+plusMinus : T_PLUS {$$ = OP_PLUS;}
+	| T_MINUS	{$$ = OP_MINUS;}
 	;
 
-boolRest : T_EQ 	{$$ = new std::string("Eq");}
-	| T_NEQ 		{$$ = new std::string("Neq");}
-	| T_LT 			{$$ = new std::string("Lt");}
-	| T_LEQ			{$$ = new std::string("Leq");}
-	| T_GT 			{$$ = new std::string("Gt");}
-	| T_GEQ 		{$$ = new std::string("Geq");}
+boolRest : T_EQ 	{$$ = OP_EQ;}
+	| T_NEQ 		{$$ = OP_NEQ;}
+	| T_LT 			{$$ = OP_LT;}
+	| T_LEQ			{$$ = OP_LEQ;}
+	| T_GT 			{$$ = OP_GT;}
+	| T_GEQ 		{$$ = OP_GEQ;}
 	;
 
-boolAnd : T_AND			{$$ = new std::string("And");}
-boolOr  : T_OR 			{$$ = new std::string("Or");}
+boolAnd : T_AND			{$$ = OP_AND;}
+boolOr  : T_OR 			{$$ = OP_OR;}
 
 
 method_call: T_ID T_LPAREN method-arg-list T_RPAREN 
-	{ $$ = new MethodCallAST(*$1,(decafStmtList*)$3); delete $1;}
+	{ $$ = new MethodCallAST($1,(decafStmtList*)$3);}
 
 method-arg-list: method-arg T_COMMA method-arg-list
 	{
@@ -368,13 +464,12 @@ method-arg-list: method-arg T_COMMA method-arg-list
 	;
 
 method-arg: expr {$$ = $1;}
-	| T_STRINGCONSTANT {$$ = new MethodArgAST(*$1); delete $1;}
+	| T_STRINGCONSTANT {$$ = new MethodArgAST($1.str());}
 	;
 
 arrayType : T_LSB T_INTCONSTANT T_RSB
 	{
-		$$ = new ArrayAST(*$2);
-		delete $2;
+		$$ = new ArrayAST($2.str(), intLiteral($2.str()));
 	}
 	;
 
@@ -420,12 +515,27 @@ method-dec-list : method-dec method-dec-list
 		slist -> push_front($1);
 		$$ = slist;
 	}
-	| method-dec {decafStmtList *slist =  new decafStmtList(); slist -> push_front($1); $$ = slist;}
+	| { decafStmtList *slist = new decafStmtList(); $$ = slist; }
 	;
 
+// every entry of the list is a MethodDeclAST, a package without methods
+// has an empty list
 method-dec: T_FUNC T_ID T_LPAREN dec-var-structR T_RPAREN method_type mBlock
-	{$$ = new MethodDeclAST(*$2,(decafStmtList*)$4,*$6,$7); delete $2; delete $6;}
-	| { decafStmtList *slist = new decafStmtList(); $$ = slist; }
+	{
+		$$ = new MethodDeclAST($2,(decafStmtList*)$4,$6,$7);
+		if (ci->options.streamMethods()) {
+			// only the function is kept, the list gets a NULL
+			if (!streamCodegen(ci, $$)) {
+				YYABORT;
+			}
+			// with --pipeline the method may not be generated yet, the
+			// arena is released as a whole after the parse
+			if (!ci->options.pipelined()) {
+				ci->arena.release(ci->streamMark);
+			}
+			$$ = NULL;
+		}
+	}
 	;
 
 mBlock: T_LCB var-decl-list statements T_RCB {$$ = new MethodBlockAST((decafStmtList *)$2, (decafStmtList *)$3);}
@@ -441,7 +551,7 @@ dec-var-structR: dec-var-struct T_COMMA dec-var-structR
 	| { decafStmtList *slist = new decafStmtList(); $$ = slist; }
 	;
 
-dec-var-struct: T_ID decaf_type { $$ = new VarDefAST(*$1,*$2); delete $1; delete $2;}
+dec-var-struct: T_ID decaf_type { $$ = new VarDefAST($1,$2);}
 
 field-decR: field-dec field-decR
 	{
@@ -459,35 +569,33 @@ field-dec: T_VAR mul-field-decR T_SEMICOLON
 	}
 	| T_VAR T_ID decaf_type T_SEMICOLON
 	{
-		IdAST* temp = new IdAST(*$2);
-		IdAST* temp1= new IdAST("Scalar");
-		$$ = new FieldDeclAST((decafAST*)temp,*$3, (decafAST*)temp1);
-		delete $3;
+		IdAST* temp = new IdAST($2);
+		ScalarAST* temp1= new ScalarAST();
+		$$ = new FieldDeclAST(temp,$3, (decafAST*)temp1, true);
 	}
 	| T_VAR mul-arr-decR T_SEMICOLON {$$ = $2;}
-	| T_VAR T_ID arrayType decaf_type T_SEMICOLON { IdAST* temp = new IdAST(*$2); $$ = new FieldDeclAST((decafAST*)temp, *$4, (decafAST*)$3); delete $2;}
+	| T_VAR T_ID arrayType decaf_type T_SEMICOLON { IdAST* temp = new IdAST($2); $$ = new FieldDeclAST(temp, $4, (decafAST*)$3, false, ((ArrayAST*)$3)->size());}
 	| T_VAR T_ID decaf_type T_ASSIGN const T_SEMICOLON
 	{
-		$$ = new AssignGlobalVarAST(*$2,*$3,$5);
-		delete $2;
-		delete $3;
+		$$ = new AssignGlobalVarAST($2,$3,$5);
+
 	}
 	;
 
 mul-field-decR: T_ID T_COMMA mul-field-decR { 
 		decafStmtList* sList = (decafStmtList*) $3;
 		FieldDeclAST* last = (FieldDeclAST*)(sList -> lastElement());
-		string type = last -> returnType(); 
-		IdAST* temp = new IdAST(*$1);
-		IdAST* temp1= new IdAST("Scalar");
-		$$ = new FieldDeclAST((decafAST*)temp,type, (decafAST*)temp1);
+		decafType type = last -> returnType(); 
+		IdAST* temp = new IdAST($1);
+		ScalarAST* temp1= new ScalarAST();
+		$$ = new FieldDeclAST(temp,type, (decafAST*)temp1, true);
 		sList -> push_front($$);
 		$$ = sList;
 	}
 	| T_ID decaf_type	{ decafStmtList* sList = new decafStmtList();
-		IdAST* temp = new IdAST(*$1);
-		IdAST* temp1= new IdAST("Scalar");
-		$$ = new FieldDeclAST((decafAST*)temp,*$2, (decafAST*)temp1);
+		IdAST* temp = new IdAST($1);
+		ScalarAST* temp1= new ScalarAST();
+		$$ = new FieldDeclAST(temp,$2, (decafAST*)temp1, true);
 		sList-> push_front($$); 
 		$$ = sList; 
 	}
@@ -496,18 +604,17 @@ mul-field-decR: T_ID T_COMMA mul-field-decR {
 mul-arr-decR: T_ID T_COMMA mul-arr-decR { 
 		decafStmtList* sList = (decafStmtList*) $3;
 		FieldDeclAST* last = (FieldDeclAST*)(sList -> lastElement());
-		string type = last -> returnType(); 
-		string arrT = last -> returnArr();
-		IdAST* temp = new IdAST(*$1);
-		IdAST* temp1 = new IdAST(arrT);
-		$$ = new FieldDeclAST((decafAST*)temp,type, (decafAST*)temp1);
+		decafType type = last -> returnType(); 
+		decafAST* arrT = last -> returnArr();
+		IdAST* temp = new IdAST($1);
+		$$ = new FieldDeclAST(temp,type, arrT, false, last -> arraySize());
 		sList -> push_front($$);
 		$$ = sList;
 	}
 	| T_ID arrayType decaf_type	{ 
 		decafStmtList* sList = new decafStmtList();
-		IdAST* temp = new IdAST(*$1); 
-		$$ = new FieldDeclAST(temp,*$3, $2); 
+		IdAST* temp = new IdAST($1); 
+		$$ = new FieldDeclAST(temp,$3, $2, false, ((ArrayAST*)$2)->size()); 
 		sList-> push_front($$); 
 		$$ = sList; }
 	;
@@ -528,9 +635,8 @@ externR: extern externR
 	;
 extern: T_EXTERN T_FUNC T_ID T_LPAREN extern_typeR T_RPAREN method_type T_SEMICOLON
 	{
-		$$ = new ExternFunctionAST(*$3, *$7, $5);
-		delete $3;
-		delete $7;
+		$$ = new ExternFunctionAST($3, $7, $5);
+
 	}
 	
       
@@ -540,32 +646,590 @@ extern: T_EXTERN T_FUNC T_ID T_LPAREN extern_typeR T_RPAREN method_type T_SEMICO
 
 %%
 
-int main() {
-  // initialize LLVM
-  llvm::LLVMContext &Context = TheContext;
+// outputs that only depend on the source and the options; running the
+// program or printing the AST is always done afresh
+bool CompilerInstance::cacheable() const {
+  return cache && !options.runProgram && !options.useVM && !options.printAST && options.outputFile != "-";
+}
+
+string CompilerInstance::codegenFlags() const {
+  string flags = "-O" + to_string(options.optLevel);
+  flags += options.releaseMode ? " --release" : "";
+  flags += options.boundsChecks ? "" : " --no-bounds-check";
+  // -j and --incremental optimize the methods one by one, any N gives
+  // the same output
+  flags += options.perMethod() ? " -j" : "";
+  return flags;
+}
+
+string CompilerInstance::outputFlags() const {
+  string flags = codegenFlags();
+  if (!options.nativeFile.empty()) {
+    flags += options.nativeAssembly ? " -S" : " -c";
+  } else if (!options.outputFile.empty()) {
+    flags += options.emitBitcode ? " --emit=bc" : " --emit=ll";
+  }
+  return flags;
+}
+
+// look the source up in the cache, compile it on a miss and keep the result
+int CompilerInstance::compileCached(const string &source) {
+  string key = compileCache::key(source, outputFlags());
+  const string &file = !options.nativeFile.empty() ? options.nativeFile : options.outputFile;
+  bool hit = file.empty() ? cache->fetch(key, err) : cache->fetch(key, file);
+  int retval = EXIT_SUCCESS;
+  if (!hit) {
+    cacheKey = key;
+    retval = compileBytes(source);
+    cacheKey.clear();
+  }
+  // a miss was flushed by compile()
+  cache->flush();
+  if (options.printStats) {
+    err << "cache: " << (hit ? "hit " : "miss ") << key << endl;
+    cache->printStats(err);
+  }
+  return retval;
+}
+
+int CompilerInstance::compileFile(const string &path) {
+  // a cache hit costs reading and hashing the source, and copying the
+  // output; --stream scans the source twice, --batch-lex scans it into
+  // the token buffer
+  if (cacheable() || options.streamMethods() || options.batchLexing()) {
+    ifstream in;
+    if (!path.empty()) {
+      in.open(path.c_str(), ios::binary);
+      if (!in) {
+        err << "error: cannot open " << path << endl;
+        return EXIT_FAILURE;
+      }
+    }
+    istream &is = path.empty() ? cin : in;
+    string source((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+    return cacheable() ? compileCached(source) : compileBytes(source);
+  }
+  lexerState st;
+  st.arena = &arena;
+  st.identifiers = &identifiers;
+  st.err = &err;
+  // scan a source file in place, pipes go through flex's own buffer
+  FILE *source = stdin;
+  if (!path.empty() && (source = fopen(path.c_str(), "r")) == NULL) {
+    err << "error: cannot open " << path << endl;
+    return EXIT_FAILURE;
+  }
+  void *scanner = lexerCreate(&st);
+  if (!lexerMapInput(scanner, fileno(source))) {
+    lexerSetInput(scanner, source);
+  }
+  int retval = compile(scanner, NULL);
+  lexerDestroy(scanner);
+  if (source != stdin) {
+    fclose(source);
+  }
+  return retval;
+}
+
+int CompilerInstance::compileString(const string &source) {
+  if (cacheable()) {
+    return compileCached(source);
+  }
+  return compileBytes(source);
+}
+
+int CompilerInstance::compileBytes(const string &source) {
+  // --pipeline and --batch-lex run their own scanner over source
+  if (options.pipelined() || options.batchLexing()) {
+    return compile(NULL, &source);
+  }
+  lexerState st;
+  st.arena = &arena;
+  st.identifiers = &identifiers;
+  st.err = &err;
+  void *scanner = lexerCreate(&st);
+  lexerScanBytes(scanner, source.data(), source.size());
+  int retval = compile(scanner, &source);
+  lexerDestroy(scanner);
+  return retval;
+}
+
+static bool prescanType(int tok, decafType &ty) {
+  switch (tok) {
+  case T_INTTYPE: ty = TY_INT; return true;
+  case T_BOOLTYPE: ty = TY_BOOL; return true;
+  case T_VOID: ty = TY_VOID; return true;
+  }
+  return false;
+}
+
+// --stream: find the package's methods ahead of the parse, so they can be
+// declared before any body and a call can go forward to a method that has
+// not been parsed yet. A quiet pass of the scanner picks out each
+// "func name(params) type" after the package keyword; the parse reports
+// whatever does not fit.
+void CompilerInstance::predeclare(const string &source) {
+  lexerState st;
+  st.arena = &arena;
+  st.identifiers = &identifiers;
+  st.err = &err;
+  st.quiet = true;
+  void *scanner = lexerCreate(&st);
+  lexerScanBytes(scanner, source.data(), source.size());
+  streamPrototypes.clear();
+  YYSTYPE val;
+  int tok;
+  while ((tok = lexerNext(&val, scanner)) > 0 && tok != T_PACKAGE) {
+  }
+  while (tok > 0) {
+    if ((tok = lexerNext(&val, scanner)) != T_FUNC || (tok = lexerNext(&val, scanner)) != T_ID) {
+      continue;
+    }
+    int name = val.id;
+    if ((tok = lexerNext(&val, scanner)) != T_LPAREN) {
+      continue;
+    }
+    decafStmtList *params = new decafStmtList();
+    decafType ty;
+    for (tok = lexerNext(&val, scanner); tok == T_ID; ) {
+      int param = val.id;
+      if (!prescanType(tok = lexerNext(&val, scanner), ty) || ty == TY_VOID) {
+        break;
+      }
+      params->push_back(new VarDefAST(param, ty));
+      if ((tok = lexerNext(&val, scanner)) == T_COMMA) {
+        tok = lexerNext(&val, scanner);
+      }
+    }
+    if (tok == T_RPAREN && prescanType(tok = lexerNext(&val, scanner), ty)) {
+      streamPrototypes.push_back(new MethodDeclAST(name, params, ty, NULL));
+    }
+  }
+  lexerDestroy(scanner);
+}
+
+// where the token the scanner returned last starts in the source; at the
+// end of input the position of the last token is stale
+static size_t tokenStart(lexerState *st) {
+  size_t start = st->lineStart + st->tokenpos - 1;
+  return start < st->inputPos ? start : st->inputPos;
+}
+
+// a syntax error at the token between start and end of source, shown like
+// the flex scanner's lexerReportError does
+static void reportSyntaxError(ostream &os, const char *s, const string &source, int lineno, int tokenpos, size_t start, size_t end) {
+  size_t back = tokenpos - 1;
+  if (back > maxErrorContext) {
+    back = maxErrorContext;
+  }
+  if (back > start) {
+    back = start;
+  }
+  os << lineno << ": " << s << " at char " << tokenpos << " " << source.substr(start - back, end - start + back) << endl;
+}
+
+// --pipeline: a token as the scanning thread hands it to the parser,
+// with what a syntax error at it reports
+struct pipeToken {
+  int kind;
+  YYSTYPE val;
+  int lineno;
+  int tokenpos;
+  size_t start, end;     // the token's offsets in the source
+  const char *message;   // of an error token
+};
+
+struct tokenBatch {
+  size_t count;
+  pipeToken tokens[256];
+};
+
+/// tokenPipe - the parser's end of the scanning thread of --pipeline.
+/// Tokens come in batches through a lock-free ring, so the two threads
+/// meet once per batch rather than once per token; the last batch ends
+/// with the end of input or an error token. The scanner runs quietly,
+/// its messages are printed when the parser reads the tokens. Like a
+/// syntax error, they are only printed once code generation has caught
+/// up without a semantic error, which the serial parse would have
+/// stopped at first.
+class tokenPipe {
+  const string &source;
+  spscRing<tokenBatch, 16> ring;
+  tokenBatch current;
+  size_t next;
+  pipeToken last;
+public:
+  tokenPipe(const string &src) : source(src), next(0) {
+    current.count = 0;
+    last.lineno = 1;
+    last.tokenpos = 1;
+    last.start = last.end = 0;
+  }
+
+  // the scanning thread's loop
+  void scan(void *scanner, lexerState *st) {
+    tokenBatch *batch = new tokenBatch;
+    batch->count = 0;
+    for (;;) {
+      pipeToken &t = batch->tokens[batch->count++];
+      t.kind = lexerNext(&t.val, scanner);
+      t.lineno = st->lineno;
+      t.tokenpos = st->tokenpos;
+      t.start = tokenStart(st);
+      t.end = st->inputPos;
+      t.message = t.kind < 0 ? st->error : NULL;
+      if (t.kind <= 0 || batch->count == 256) {
+        if (!ring.push(*batch) || t.kind <= 0) {
+          break;
+        }
+        batch->count = 0;
+      }
+    }
+    delete batch;
+  }
+  // release the scanning thread if the parser stops early
+  void cancel() { ring.cancel(); }
+
+  int read(CompilerInstance *ci, YYSTYPE *lvalp) {
+    if (next == current.count) {
+      if (!ring.pop(current)) {
+        return 0;
+      }
+      next = 0;
+    }
+    last = current.tokens[next++];
+    if (last.message != NULL && finishCodegen(ci)) {
+      ci->err << last.message << endl;
+    }
+    *lvalp = last.val;
+    return last.kind;
+  }
+
+  void reportError(CompilerInstance *ci, const char *s) {
+    if (!finishCodegen(ci)) {
+      return;
+    }
+    reportSyntaxError(ci->err, s, source, last.lineno, last.tokenpos, last.start, last.end);
+  }
+};
+
+/// tokenReader - the parser's end of the tokenBuffer of --batch-lex. The
+/// values are rebuilt from the arrays as the tokens are read: the id of
+/// an identifier, the text of a constant as a view into the source.
+class tokenReader {
+  const tokenBuffer &tokens;
+  const string &source;
+  ostream &err;
+  size_t next;
+public:
+  tokenReader(const tokenBuffer &t, const string &src, ostream &e) : tokens(t), source(src), err(e), next(0) {}
+
+  int read(YYSTYPE *lvalp) {
+    // the buffer ends with the end of input or an error, which the
+    // parser does not read past
+    size_t i = next < tokens.size() ? next++ : tokens.size() - 1;
+    int kind = tokens.kind[i];
+    if (kind == T_ID) {
+      lvalp->id = tokens.ident[i];
+    } else {
+      lvalp->tok.ptr = source.data() + tokens.offset[i];
+      lvalp->tok.len = tokens.length[i];
+    }
+    if (kind < 0 && tokens.error != NULL) {
+      err << tokens.error << endl;
+    }
+    return kind;
+  }
+
+  void reportError(const char *s) {
+    size_t i = next > 0 ? next - 1 : 0;
+    reportSyntaxError(err, s, source, tokens.line[i], tokens.column[i], tokens.offset[i], tokens.offset[i] + tokens.length[i]);
+  }
+};
+
+int yylex(YYSTYPE *lvalp, CompilerInstance *ci, void *scanner) {
+  if (ci->options.pipelined()) {
+    return ((tokenPipe *)scanner)->read(ci, lvalp);
+  }
+  if (ci->options.batchLexing()) {
+    return ((tokenReader *)scanner)->read(lvalp);
+  }
+  return lexerNext(lvalp, scanner);
+}
+
+int yyerror(CompilerInstance *ci, void *scanner, const char *s) {
+  if (ci->options.pipelined()) {
+    ((tokenPipe *)scanner)->reportError(ci, s);
+  } else if (ci->options.batchLexing()) {
+    ((tokenReader *)scanner)->reportError(s);
+  } else {
+    lexerReportError(scanner, ci->err, s);
+  }
+  return 1;
+}
+
+// --pipeline: scan on one thread, parse on this one and generate code on
+// a third. The threads hand each other tokens and finished methods
+// through lock-free rings, so a method is generated while the ones after
+// it are scanned and parsed. The scanner reads the source in place, the
+// token text stays valid until every thread is done.
+int CompilerInstance::parsePipelined(const string &source) {
+  lexerState st;
+  st.arena = &arena;
+  st.identifiers = &identifiers;
+  st.err = &err;
+  st.quiet = true;
+  void *scanner = lexerCreate(&st);
+  lexerScanBytes(scanner, source.data(), source.size());
+  unique_ptr<tokenPipe> tokens(new tokenPipe(source));
+  thread lexer([&]() { tokens->scan(scanner, &st); });
+  pipe.reset(new codegenPipe);
+  pipe->worker = thread([this]() {
+    beginCodegen(this, context.get(), builder.get(), module.get());
+    symtbl.push_scope();
+    codegenItem item;
+    while (pipe->items.pop(item) && item.node != NULL) {
+      // after the first error the rest is only drained
+      if (pipe->failed.load(memory_order_relaxed)) {
+        continue;
+      }
+      try {
+        streamStep(item.node, item.declare);
+      }
+      catch (std::runtime_error &e) {
+        pipe->error = e.what();
+        pipe->failed.store(true);
+      }
+    }
+    symtbl.pop_scope();
+    endCodegen();
+  });
+  int retval = yyparse(this, tokens.get());
+  // on a syntax error the other threads are still waiting for more
+  tokens->cancel();
+  lexer.join();
+  if (pipe->worker.joinable()) {
+    pipe->items.cancel();
+    pipe->worker.join();
+  }
+  pipe.reset();
+  lexerDestroy(scanner);
+  return retval;
+}
+
+// --batch-lex: scan the whole source into the token buffer, quietly, then
+// parse from the buffer. Offsets are 32 bits, which is plenty for Decaf.
+int CompilerInstance::parseBuffered(const string &source) {
+  if (source.size() > UINT32_MAX) {
+    err << "error: --batch-lex takes sources of up to 4GB" << endl;
+    return 1;
+  }
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  lexerState st;
+  st.arena = &arena;
+  st.identifiers = &identifiers;
+  st.err = &err;
+  st.quiet = true;
+  void *scanner = lexerCreate(&st);
+  lexerScanBytes(scanner, source.data(), source.size());
+  tokens.clear();
+  YYSTYPE val;
+  int kind;
+  do {
+    kind = lexerNext(&val, scanner);
+    size_t begin = tokenStart(&st);
+    tokens.push(kind, begin, st.inputPos - begin, st.lineno, st.tokenpos, kind == T_ID ? val.id : -1);
+  } while (kind > 0);
+  tokens.error = st.error;
+  lexerDestroy(scanner);
+  if (options.printStats) {
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    err << "lex: " << tokens.size() << " tokens in " << elapsed.count() << " ms, " << tokens.bytes() / 1024 << " KB" << endl;
+  }
+  tokenReader reader(tokens, source, err);
+  return yyparse(this, &reader);
+}
+
+int CompilerInstance::compile(void *scanner, const string *source) {
+  semanticError = false;
+  identifiers.clear();
+  mainId = identifiers.intern("main");
+  bytecode = vmProgram();
+  // initialize LLVM, a fresh context so nothing is shared with earlier runs
+  builder.reset();
+  module.reset();
+  context.reset(new llvm::LLVMContext);
+  context->setDiscardValueNames(options.releaseMode);
   // Make the module, which holds all the code.
-  TheModule = new llvm::Module("Test", Context);
-  llvm::BasicBlock *BB = llvm::BasicBlock::Create(TheContext, "entry", TheFunction);
-   Builder.SetInsertPoint(BB);
-   // set up symbol table
-  symbol_table a;
-  symtbl.push_front(a);
-  // set up dummy main function
-  //TheFunction = gen_main_def();
+  module.reset(new llvm::Module("Test", *context));
+  builder.reset(new llvm::IRBuilder<>(*context));
+  beginCodegen(this, context.get(), builder.get(), module.get());
+  // set up symbol table
+  symtbl.push_scope();
+  if (options.streamMethods() && source != NULL) {
+    predeclare(*source);
+  }
   // parse the input and create the abstract syntax tree
-  int retval = yyparse();
+  int retval;
+  if (options.pipelined() && source != NULL) {
+    retval = parsePipelined(*source);
+  } else if (options.batchLexing() && source != NULL) {
+    retval = parseBuffered(*source);
+  } else {
+    retval = yyparse(this, scanner);
+  }
   // remove symbol table
+  symtbl.pop_scope();
+  endCodegen();
+  arena.reset();
+  int status = semanticError ? EXIT_FAILURE : finish(retval);
+  // one stats update and eviction check for everything --incremental
+  // looked up and stored, method by method, and for the output
+  if (cache) {
+    cache->flush();
+  }
+  return status;
+}
 
-  symtbl.pop_front();
-  // Finish off the main function. (see the WARNING above)
-  // return 0 from main, which is EXIT_SUCCESS
-  Builder.CreateRet(llvm::ConstantInt::get(TheContext, llvm::APInt(32, 0)));
-  // Validate the generated code, checking for consistency.
-  //verifyFunction(*TheFunction);
-  // Print out all of the generated code to stderr
-  TheModule->print(llvm::errs(), nullptr);
+// run or write out what the parse produced
+int CompilerInstance::finish(int retval) {
+  if (options.useVM) {
+    if (retval != 0) {
+      return EXIT_FAILURE;
+    }
+    try {
+      if (options.tierThreshold > 0) {
+        return runTiered(bytecode, options.tierThreshold, options.printStats);
+      }
+      return runVM(bytecode);
+    }
+    catch (std::runtime_error &e) {
+      fflush(stdout);
+      err << "runtime error: " << e.what() << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  // with -j<N> or --incremental the methods were optimized one by one as
+  // they were generated
+  if (retval == 0 && !options.perMethod()) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    try {
+      optimizeModule(module.get(), options.optLevel);
+    }
+    catch (std::runtime_error &e) {
+      err << "error: " << e.what() << endl;
+      return EXIT_FAILURE;
+    }
+    if (options.printStats) {
+      chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+      err << "opt: -O" << options.optLevel << " in " << elapsed.count() << " ms" << endl;
+    }
+  }
+  if (retval == 0 && options.runProgram) {
+    builder.reset();
+    return runJIT(std::move(module), std::move(context));
+  }
+  if (retval == 0 && (!options.nativeFile.empty() || !options.outputFile.empty())) {
+    try {
+      if (!options.nativeFile.empty()) {
+        emitNative(module.get(), options.nativeFile, options.nativeAssembly, options.optLevel);
+      } else {
+        emitModule(module.get(), options.outputFile, options.emitBitcode);
+      }
+      if (!cacheKey.empty()) {
+        cache->storeFile(cacheKey, !options.nativeFile.empty() ? options.nativeFile : options.outputFile);
+      }
+    }
+    catch (std::runtime_error &e) {
+      err << "error: " << e.what() << endl;
+      return EXIT_FAILURE;
+    }
+  } else {
+    // Print out all of the generated code, through one buffer rather
+    // than a write per token of IR
+    if (retval == 0 && !cacheKey.empty()) {
+      string ir;
+      llvm::raw_string_ostream os(ir);
+      module->print(os, nullptr);
+      cache->store(cacheKey, os.str());
+      err << ir;
+    } else {
+      llvm::raw_os_ostream os(err);
+      module->print(os, nullptr);
+    }
+  }
 
-  
   return(retval >= 1 ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+// a host process embedding the compiler builds with -DDECAF_LIBRARY and
+// uses CompilerInstance directly
+#ifndef DECAF_LIBRARY
+int main(int argc, char **argv) {
+  compilerOptions opts;
+  // CI drives decafcomp through llvm-run, which passes no flags
+  if (getenv("DECAF_CACHE_DIR") != NULL) {
+    opts.cacheDir = getenv("DECAF_CACHE_DIR");
+  }
+  if (getenv("DECAF_CACHE_SIZE") != NULL && atoi(getenv("DECAF_CACHE_SIZE")) > 0) {
+    opts.cacheSize = (uint64_t)atoi(getenv("DECAF_CACHE_SIZE")) << 20;
+  }
+  // source file, stdin if not given; --run needs it so the program gets stdin
+  const char *sourceFile = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      opts.printStats = true;
+    } else if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '3' && argv[i][3] == '\0') {
+      opts.optLevel = argv[i][2] - '0';
+    } else if ((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "-S") == 0) && i + 1 < argc) {
+      opts.nativeAssembly = argv[i][1] == 'S';
+      opts.nativeFile = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      opts.outputFile = argv[++i];
+    } else if (strcmp(argv[i], "--emit=ll") == 0 || strcmp(argv[i], "--emit=bc") == 0) {
+      opts.emitBitcode = argv[i][7] == 'b';
+    } else if (strcmp(argv[i], "--release") == 0) {
+      opts.releaseMode = true;
+    } else if (strcmp(argv[i], "--no-bounds-check") == 0) {
+      opts.boundsChecks = false;
+    } else if (argv[i][0] == '-' && argv[i][1] == 'j' && atoi(argv[i] + 2) > 0) {
+      opts.codegenJobs = atoi(argv[i] + 2);
+    } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+      opts.cacheDir = argv[i] + 8;
+    } else if (strncmp(argv[i], "--cache-size=", 13) == 0 && atoi(argv[i] + 13) > 0) {
+      opts.cacheSize = (uint64_t)atoi(argv[i] + 13) << 20;
+    } else if (strcmp(argv[i], "--no-cache") == 0) {
+      opts.cacheDir.clear();
+    } else if (strcmp(argv[i], "--incremental") == 0) {
+      opts.incremental = true;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      opts.stream = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      opts.pipeline = true;
+    } else if (strcmp(argv[i], "--batch-lex") == 0) {
+      opts.batchLex = true;
+    } else if (strcmp(argv[i], "--run") == 0) {
+      opts.runProgram = true;
+    } else if (strcmp(argv[i], "--vm") == 0) {
+      opts.useVM = true;
+    } else if (strcmp(argv[i], "--tier") == 0) {
+      opts.useVM = true;
+      opts.tierThreshold = 1000;
+    } else if (strncmp(argv[i], "--tier=", 7) == 0 && atoi(argv[i] + 7) > 0) {
+      opts.useVM = true;
+      opts.tierThreshold = atoi(argv[i] + 7);
+    } else if (argv[i][0] != '-' && sourceFile == NULL) {
+      sourceFile = argv[i];
+    } else {
+      cerr << "usage: " << argv[0] << " [--stats] [--release] [--no-bounds-check] [--stream | --pipeline] [--batch-lex] [-O0|-O1|-O2|-O3] [-j<N>] [--cache=DIR [--cache-size=MB] [--incremental] | --no-cache] [--run | --vm | --tier[=N] | -c out.o | -S out.s | [--emit=ll|bc] -o out] [source]" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (opts.incremental && opts.cacheDir.empty()) {
+    cerr << "error: --incremental keeps the methods in the cache, it needs --cache=DIR" << endl;
+    return EXIT_FAILURE;
+  }
+  CompilerInstance ci(opts);
+  return ci.compileFile(sourceFile != NULL ? sourceFile : "");
+}
+#endif
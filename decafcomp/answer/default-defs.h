@@ -11,22 +11,71 @@
 #include <cstdio> 
 #include <cstdlib>
 #include <cstring> 
+#include <ostream>
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include "decaf-arena.h"
+#include "decaf-symtbl.h"
 
-extern int lineno;
-extern int tokenpos;
+// token text passed from the lexer to the parser: a view into the
+// memory-mapped source, or into the arena when the input is a pipe
+struct tokenText {
+	const char *ptr;
+	int len;
+	std::string str() const { return std::string(ptr, len); }
+};
 
-using namespace std;
+/// lexerState - what the reentrant scanner of one compilation keeps, its
+/// yyextra. Identifiers are interned into the compilation's interner,
+/// the AST and symbol table use the ids.
+struct lexerState {
+	int lineno = 1;
+	int tokenpos = 1;   // column of the current token
+	// offsets into the input, advanced for every matched token
+	size_t inputPos = 0;    // next character
+	size_t lineStart = 0;   // first character of the current line
+	// set when the scanner reads a buffer that outlives the parse, token
+	// text then points into it instead of being copied to the arena
+	bool inPlace = false;
+	// scanning ahead: errors are reported by the parse that follows
+	bool quiet = false;
+	// message of the last error token (kind -1)
+	const char *error = NULL;
+	// where scanning errors are printed, the compilation's err stream
+	std::ostream *err = NULL;
+	char *mappedInput = NULL;
+	size_t mappedSize = 0;
+	decafArena *arena;
+	symbolInterner *identifiers;
+};
+
+// a scanner for st; lexerDestroy also unmaps a mapped input
+void *lexerCreate(lexerState *st);
+void lexerDestroy(void *scanner);
+// scan straight from a memory mapping of fd, returns 0 if fd is not a file
+int lexerMapInput(void *scanner, int fd);
+void lexerSetInput(void *scanner, FILE *in);
+// scan a copy of len bytes at s
+void lexerScanBytes(void *scanner, const char *s, size_t len);
+// the syntax error message for the token the scanner returned last
+void lexerReportError(void *scanner, std::ostream &os, const char *s);
+// how much of the line before the offending token a syntax error shows
+static const size_t maxErrorContext = 80;
+
+// operators and types are resolved to these tags by the parser,
+// the AST keeps the tag and codegen dispatches on it with a switch
+enum decafOp {
+	OP_PLUS, OP_MINUS, OP_MULT, OP_DIV, OP_MOD, OP_LEFTSHIFT, OP_RIGHTSHIFT,
+	OP_LT, OP_LEQ, OP_GT, OP_GEQ, OP_EQ, OP_NEQ, OP_AND, OP_OR,
+	OP_UNARYMINUS, OP_NOT
+};
 
-extern "C"
-{
-	extern int yyerror(const char *);
-	int yyparse(void);
-	int yylex(void);  
-	int yywrap(void);
-}
+enum decafType {
+	TY_VOID, TY_INT, TY_BOOL, TY_STRING
+};
+
+using namespace std;
 
 #endif
 
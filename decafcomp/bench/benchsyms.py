@@ -0,0 +1,50 @@
+"""
+Time decafcomp on generated packages with more and more symbols.
+
+First build decafcomp in ../answer/, then run:
+
+    python3 benchsyms.py
+
+For each N it generates N fields and N methods with gensyms.py,
+compiles the package to LLVM assembly and reports the best of a few
+runs. Pass -c to time a second decafcomp, e.g. a build of an older
+commit, on the same inputs.
+"""
+
+import os, sys, optparse, subprocess, tempfile, time
+import gensyms
+
+def best(decafcomp, path, runs):
+    times = []
+    for _ in range(runs):
+        with open(path) as source:
+            start = time.perf_counter()
+            prog = subprocess.run([decafcomp], stdin=source, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            times.append(time.perf_counter() - start)
+        if prog.returncode != 0:
+            raise RuntimeError("{} failed on {}".format(decafcomp, path))
+    return min(times)
+
+if __name__ == '__main__':
+    bench_dir = os.path.dirname(os.path.abspath(sys.argv[0]))
+    optparser = optparse.OptionParser()
+    optparser.add_option("-a", "--answerdir", dest="answer_dir", default=os.path.join(bench_dir, "..", "answer"), help="answer directory [default: ../answer]")
+    optparser.add_option("-c", "--compare", dest="compare", default=None, help="another decafcomp to time on the same inputs")
+    optparser.add_option("-s", "--sizes", dest="sizes", default="500,1000,2000,4000", help="values of N [default: 500,1000,2000,4000]")
+    optparser.add_option("-d", "--depth", dest="depth", type="int", default=1, help="nested blocks around each field access [default: 1]")
+    optparser.add_option("-r", "--runs", dest="runs", type="int", default=3, help="runs per size, the best is reported [default: 3]")
+    (opts, _) = optparser.parse_args()
+
+    programs = [os.path.abspath(os.path.join(opts.answer_dir, "decafcomp"))]
+    if opts.compare is not None:
+        programs.append(os.path.abspath(opts.compare))
+    print("{:>6}".format("N") + "".join("{:>14}".format(h) for h in ["decafcomp (s)", "compare (s)"][:len(programs)]))
+    for size in [int(s) for s in opts.sizes.split(",")]:
+        fd, path = tempfile.mkstemp(".decaf")
+        try:
+            with os.fdopen(fd, "w") as out:
+                gensyms.generate(size, opts.depth, out)
+            times = [best(p, path, opts.runs) for p in programs]
+        finally:
+            os.remove(path)
+        print("{:>6}".format(size) + "".join("{:>14.3f}".format(t) for t in times))
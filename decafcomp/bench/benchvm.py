@@ -0,0 +1,78 @@
+"""
+Time the three ways decafcomp can run a program on the dev testcases.
+
+First build decafcomp in ../answer/, then run:
+
+    python3 benchvm.py
+
+Every testcase with an .out reference is run, with its .in file on
+stdin if there is one, as:
+
+    vm    decafcomp --vm, the bytecode interpreter
+    jit   decafcomp --run, the ORC JIT
+    llc   llvm-run: decafcomp to LLVM assembly, llvm-as, llc, link, run
+
+Each is the best of a few runs. The summary gives the median, smallest,
+largest and total per mode and how often each mode was fastest; -v
+prints every testcase. llvm-run takes LLVMCONFIG, LLVMAS, LLC and CC
+from the environment.
+"""
+
+import os, sys, glob, optparse, shutil, statistics, subprocess, tempfile, time
+
+def best(argv, stdin_path, runs, limit):
+    times = []
+    for _ in range(runs):
+        with open(stdin_path) as stdin:
+            start = time.perf_counter()
+            try:
+                subprocess.run(argv, stdin=stdin, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=limit)
+            except subprocess.TimeoutExpired:
+                return None
+            times.append(time.perf_counter() - start)
+    return min(times)
+
+if __name__ == '__main__':
+    bench_dir = os.path.dirname(os.path.abspath(sys.argv[0]))
+    optparser = optparse.OptionParser()
+    optparser.add_option("-a", "--answerdir", dest="answer_dir", default=os.path.join(bench_dir, "..", "answer"), help="answer directory [default: ../answer]")
+    optparser.add_option("-t", "--testcases", dest="testcase_dir", default=os.path.join(bench_dir, "..", "testcases", "dev"), help="testcase directory [default: ../testcases/dev]")
+    optparser.add_option("-r", "--references", dest="ref_dir", default=os.path.join(bench_dir, "..", "references", "dev"), help="references directory [default: ../references/dev]")
+    optparser.add_option("-n", "--runs", dest="runs", type="int", default=3, help="runs per mode, the best is reported [default: 3]")
+    optparser.add_option("-l", "--limit", dest="limit", type="float", default=60, help="seconds before a run is abandoned [default: 60]")
+    optparser.add_option("-v", "--verbose", dest="verbose", action="store_true", default=False, help="print every testcase")
+    (opts, _) = optparser.parse_args()
+
+    answer_dir = os.path.abspath(opts.answer_dir)
+    decafcomp = os.path.join(answer_dir, "decafcomp")
+    llvm_run = os.path.join(answer_dir, "llvm-run")
+    stdlib = os.path.join(answer_dir, "decaf-stdlib.c")
+    modes = ["vm", "jit", "llc"]
+    results = {}
+    log_dir = tempfile.mkdtemp()
+    try:
+        for source in sorted(glob.glob(os.path.join(opts.testcase_dir, "*.decaf"))):
+            name = os.path.basename(source)[:-len(".decaf")]
+            if not os.path.exists(os.path.join(opts.ref_dir, name + ".out")):
+                continue
+            stdin_path = source[:-len(".decaf")] + ".in"
+            if not os.path.exists(stdin_path):
+                stdin_path = os.devnull
+            argvs = {
+                "vm": [decafcomp, "--vm", source],
+                "jit": [decafcomp, "--run", source],
+                "llc": [sys.executable, llvm_run, "-c", decafcomp, "-l", stdlib, source, log_dir],
+            }
+            results[name] = dict((m, best(argvs[m], stdin_path, opts.runs, opts.limit)) for m in modes)
+            if opts.verbose:
+                print("{:<28}".format(name) + "".join("{:>4} {:>10}".format(m, "timeout" if results[name][m] is None else "%.1f ms" % (results[name][m] * 1000)) for m in modes))
+    finally:
+        shutil.rmtree(log_dir)
+
+    print("{} programs".format(len(results)))
+    print("{:>6} {:>12} {:>12} {:>12} {:>12} {:>9}".format("mode", "median (ms)", "min (ms)", "max (ms)", "total (s)", "fastest"))
+    for m in modes:
+        times = [r[m] for r in results.values() if r[m] is not None]
+        fastest = sum(1 for r in results.values() if r[m] is not None and all(r[o] is None or r[m] <= r[o] for o in modes))
+        timeouts = sum(1 for r in results.values() if r[m] is None)
+        print("{:>6} {:>12.1f} {:>12.1f} {:>12.1f} {:>12.2f} {:>9}".format(m, statistics.median(times) * 1000, min(times) * 1000, max(times) * 1000, sum(times), fastest) + ("  ({} timed out)".format(timeouts) if timeouts else ""))
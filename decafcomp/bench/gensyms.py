@@ -0,0 +1,31 @@
+"""
+Generate a Decaf package with many symbols for timing symbol lookup.
+
+    python3 gensyms.py -n 4000 > syms.decaf
+
+The package has N fields and N methods. Each method reads one field
+and writes another from inside D nested blocks, each block declaring a
+local, so every field access looks up a global from D scopes deep.
+"""
+
+import sys, optparse
+
+def generate(n, depth, out):
+    out.write("extern func print_int(int) void;\n")
+    out.write("package Syms {\n")
+    for i in range(n):
+        out.write("\tvar f%d int;\n" % i)
+    for i in range(n):
+        body = "x = a + f%d; f%d = x;" % (i, (i * 7) % n)
+        for d in range(depth):
+            body = "{ var y%d int; y%d = a; %s }" % (d, d, body)
+        out.write("\tfunc m%d(a int) int { var x int; %s return x; }\n" % (i, body))
+    out.write("\tfunc main() int { print_int(m0(1)); }\n")
+    out.write("}\n")
+
+if __name__ == '__main__':
+    optparser = optparse.OptionParser()
+    optparser.add_option("-n", "--symbols", dest="symbols", type="int", default=1000, help="number of fields and of methods [default: 1000]")
+    optparser.add_option("-d", "--depth", dest="depth", type="int", default=1, help="nested blocks around each field access [default: 1]")
+    (opts, _) = optparser.parse_args()
+    generate(opts.symbols, opts.depth, sys.stdout)
@@ -0,0 +1,81 @@
+
+// Lookup cost of the scoped symbol table against the copied list of
+// scope maps it replaced, as the symbol count and scope depth grow.
+// Build with `make symtbl-bench`.
+
+#include "decaf-symtbl.h"
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include <map>
+
+using namespace std;
+
+// the table before db3137d: a list of scopes, innermost first, copied by
+// the range for on every lookup
+typedef map<string, void *> scopeMap;
+
+void *listFind(list<scopeMap> &scopes, const string &name) {
+	for (auto i : scopes) {
+		auto found = i.find(name);
+		if (found != i.end()) {
+			return found->second;
+		}
+	}
+	return NULL;
+}
+
+int main() {
+	const int sizes[] = { 100, 1000, 10000 };
+	const int depths[] = { 1, 4, 16, 64 };
+	printf("symbols depth    map list (ns)  scoped table (ns)\n");
+	for (int n : sizes) {
+		for (int depth : depths) {
+			symbolInterner ids;
+			scopedSymbolTable<void> table(ids);
+			list<scopeMap> scopes;
+			vector<string> names;
+			vector<int> nameIds;
+			int value = 0;
+			// n globals in the outermost scope, then depth - 1 scopes of 4 locals
+			table.push_scope();
+			scopes.push_front(scopeMap());
+			for (int i = 0; i < n; i++) {
+				names.push_back("f" + to_string(i));
+				nameIds.push_back(ids.intern(names.back()));
+				table.insert(nameIds.back(), &value);
+				scopes.front()[names.back()] = &value;
+			}
+			for (int d = 1; d < depth; d++) {
+				table.push_scope();
+				scopes.push_front(scopeMap());
+				for (int j = 0; j < 4; j++) {
+					string local = "l" + to_string(d) + "_" + to_string(j);
+					table.insert(ids.intern(local), &value);
+					scopes.front()[local] = &value;
+				}
+			}
+			// the old lookup is slow, give it fewer rounds
+			int listRounds = 2000000 / n / depth + 1000;
+			int tableRounds = 2000000;
+			void *sink = NULL;
+			chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+			for (int k = 0; k < listRounds; k++) {
+				sink = listFind(scopes, names[k % n]);
+			}
+			chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+			for (int k = 0; k < tableRounds; k++) {
+				sink = table.find(nameIds[k % n]);
+			}
+			chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+			if (sink != &value) {
+				fprintf(stderr, "lookup failed\n");
+				return 1;
+			}
+			printf("%7d %5d %16.1f %18.1f\n", n, depth,
+				chrono::duration<double, nano>(t1 - t0).count() / listRounds,
+				chrono::duration<double, nano>(t2 - t1).count() / tableRounds);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,45 @@
+
+#ifndef _DECAF_PRINT
+#define _DECAF_PRINT
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+/// astSink - buffered output for printing the AST. Nodes append their
+/// text directly, so printing is one linear pass over the tree. A sink
+/// bound to a FILE writes out in large blocks, otherwise it collects
+/// everything into a string.
+class astSink {
+	static const size_t flushSize = 64 * 1024;
+	FILE *file;
+	string buf;
+
+	void append(const char *s, size_t len) {
+		buf.append(s, len);
+		if (file != NULL && buf.size() >= flushSize) {
+			flush();
+		}
+	}
+public:
+	astSink() : file(NULL) {}
+	astSink(FILE *f) : file(f) { buf.reserve(flushSize); }
+	~astSink() { flush(); }
+
+	astSink &operator<<(const char *s) { append(s, strlen(s)); return *this; }
+	astSink &operator<<(const string &s) { append(s.data(), s.size()); return *this; }
+	astSink &operator<<(char c) { append(&c, 1); return *this; }
+
+	void flush() {
+		if (file != NULL && !buf.empty()) {
+			fwrite(buf.data(), 1, buf.size(), file);
+			fflush(file);
+			buf.clear();
+		}
+	}
+	const string &str() const { return buf; }
+};
+
+#endif
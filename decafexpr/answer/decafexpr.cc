@@ -1,5 +1,6 @@
 
 #include "default-defs.h"
+#include "decaf-print.h"
 #include <list>
 #include <utility>
 #include <map>
@@ -19,6 +20,9 @@
 
 using namespace std;
 
+// owns every AST node and token string of the current compilation
+decafArena astArena;
+
 // this global variable contains all the generated code
 static llvm::Module *TheModule;
 
@@ -75,29 +79,44 @@ llvm::Constant *getZeroInit(string ty) {
 /// decafAST - Base class for all abstract syntax tree nodes.
 class decafAST {
 public:
+  // nodes live in astArena and are freed together by astArena.reset()
+  static void *operator new(size_t size) { return astArena.allocate(size); }
+  static void operator delete(void *) {}
+  decafAST() { astArena.own(this); astArena.countNode(); }
   virtual ~decafAST() {}
-  virtual string str() { return string(""); }
+  virtual void print(astSink &out) {}
+  // the printed form of a single node, e.g. an identifier or array size
+  string str() { astSink s; print(s); return s.str(); }
   virtual llvm::Value *Codegen() = 0;
 };
 
-string getString(decafAST *d) {
+astSink &operator<<(astSink &out, decafAST *d) {
 	if (d != NULL) {
-		return d->str();
+		d->print(out);
 	} else {
-		return string("None");
+		out << "None";
 	}
+	return out;
+}
+
+string getString(decafAST *d) {
+	astSink s;
+	s << d;
+	return s.str();
 }
 
 template <class T>
-string commaList(list<T> vec) {
-    string s("");
-    for (typename list<T>::iterator i = vec.begin(); i != vec.end(); i++) { 
-        s = s + (s.empty() ? string("") : string(",")) + (*i)->str(); 
-    }   
-    if (s.empty()) {
-        s = string("None");
-    }   
-    return s;
+void printList(astSink &out, const list<T> &vec) {
+	if (vec.empty()) {
+		out << "None";
+		return;
+	}
+	for (typename list<T>::const_iterator i = vec.begin(); i != vec.end(); i++) {
+		if (i != vec.begin()) {
+			out << ",";
+		}
+		out << *i;
+	}
 }
 
 template <class T>
@@ -116,7 +135,7 @@ public:
 	VarDefAST(string name, string type): Name(name), Type(type) {}
 	string returnType() { return Type;}
 	string returnName() { return Name;}
-	string str() {return string("VarDef") + "(" + Name + "," + Type + ")" ;}
+	void print(astSink &out) { out << "VarDef(" << Name << "," << Type << ")"; }
 	llvm::Value* Codegen(){
 
 		llvm::Type* llType = getLLVMType(Type);
@@ -136,16 +155,11 @@ class decafStmtList : public decafAST {
 	list<decafAST *> stmts;
 public:
 	decafStmtList() {}
-	~decafStmtList() {
-		for (list<decafAST *>::iterator i = stmts.begin(); i != stmts.end(); i++) { 
-			delete *i;
-		}
-	}
 	int size() { return stmts.size(); }
 	decafAST* lastElement() { return stmts.back(); }
 	void push_front(decafAST *e) { stmts.push_front(e); }
 	void push_back(decafAST *e) { stmts.push_back(e); }
-	string str() { return commaList<class decafAST *>(stmts); }
+	void print(astSink &out) { printList(out, stmts); }
 	vector<llvm::Type *> returnArgs() {
 		vector<llvm::Type*> toReturn;
 		VarDefAST* temp;
@@ -191,12 +205,8 @@ class PackageAST : public decafAST {
 public:
 	PackageAST(string name, decafStmtList *fieldlist, decafStmtList *methodlist) 
 		: Name(name), FieldDeclList(fieldlist), MethodDeclList(methodlist) {}
-	~PackageAST() { 
-		if (FieldDeclList != NULL) { delete FieldDeclList; }
-		if (MethodDeclList != NULL) { delete MethodDeclList; }
-	}
-	string str() { 
-		return string("Package") + "(" + Name + "," + getString(FieldDeclList) + "," + getString(MethodDeclList) + ")";
+	void print(astSink &out) {
+		out << "Package(" << Name << "," << FieldDeclList << "," << MethodDeclList << ")";
 	}
 	llvm::Value *Codegen() { 
 		llvm::Value *val = NULL;
@@ -217,11 +227,7 @@ class ProgramAST : public decafAST {
 	PackageAST *PackageDef;
 public:
 	ProgramAST(decafStmtList *externs, PackageAST *c) : ExternList(externs), PackageDef(c) {}
-	~ProgramAST() { 
-		if (ExternList != NULL) { delete ExternList; } 
-		if (PackageDef != NULL) { delete PackageDef; }
-	}
-	string str() { return string("Program") + "(" + getString(ExternList) + "," + getString(PackageDef) + ")"; }
+	void print(astSink &out) { out << "Program(" << ExternList << "," << PackageDef << ")"; }
 	llvm::Value *Codegen() { 
 		llvm::Value *val = NULL;
 		if (NULL != ExternList) {
@@ -241,11 +247,7 @@ class BlockAST : public decafAST {
 	decafStmtList *statement_list;
 public:
 	BlockAST(decafStmtList* vList, decafStmtList* sList): varDefList(vList), statement_list(sList) {} 
-	~BlockAST(){ 
-		if(varDefList != NULL) {delete varDefList;}
-		if(statement_list != NULL) {delete statement_list;}
-	}
-	string str() { return string("Block") + "(" + getString(varDefList) + "," + getString(statement_list) + ")"; }
+	void print(astSink &out) { out << "Block(" << varDefList << "," << statement_list << ")"; }
 	llvm::Value* Codegen(){
 		//llvm::BasicBlock*BB = llvm::BasicBlock::Create(TheContext, "entry", (llvm::Function*)access_symtbl("func"));
 		//symtbl.front().insert(pair<string, descriptor*>(string("entry"),(llvm::Value*) BB));
@@ -268,14 +270,14 @@ public:
 class BreakStatementAST : public decafAST {
 public:
 	BreakStatementAST() {}
-	string str() {return string("BreakStmt");}
+	void print(astSink &out) { out << "BreakStmt"; }
 	llvm::Value *Codegen() { return 0;}
 };
 
 class ContinueStatementAST: public decafAST {
 public:
 	ContinueStatementAST() {}
-	string str() {return string("ContinueStmt");}
+	void print(astSink &out) { out << "ContinueStmt"; }
 	llvm::Value *Codegen() { return 0;}
 };
 
@@ -284,8 +286,7 @@ class ReturnStatementAST: public decafAST {
 public:
 	ReturnStatementAST(decafAST *input): expr(input) {}
 	ReturnStatementAST(): expr(NULL) {}
-	~ReturnStatementAST() {if (expr != NULL) { delete expr; } }
-	string str() { return string("ReturnStmt") + "(" + getString(expr) + ")" ;}
+	void print(astSink &out) { out << "ReturnStmt(" << expr << ")"; }
 	llvm::Value *Codegen() { 
 		return Builder.CreateRet(expr->Codegen());
 	}
@@ -299,13 +300,7 @@ class ForStmtAST: public decafAST {
 	decafAST *block;
 public:
 	ForStmtAST(decafStmtList *pre, decafAST* constant, decafStmtList *loop, decafAST *inputBlock): pre_assign_list(pre), loop_assign(loop), expr(constant), block(inputBlock) {}
-	~ForStmtAST() { 
-		if (pre_assign_list != NULL) { delete pre_assign_list; } 
-		if (loop_assign != NULL) { delete loop_assign; }
-		if (expr != NULL) { delete expr; }
-		if (block != NULL) { delete block; }
-	}
-	string str() {return string("ForStmt") + "(" + getString(pre_assign_list) + "," + getString(expr) + "," + getString(loop_assign) + ","+ getString(block)  + ")" ;}
+	void print(astSink &out) { out << "ForStmt(" << pre_assign_list << "," << expr << "," << loop_assign << "," << block << ")"; }
 	llvm::Value *Codegen() { return 0;}
 };
 
@@ -316,12 +311,7 @@ class IfStmtAST: public decafAST {
 public:
 	IfStmtAST(decafAST* inputExpr, decafAST* inputBlock, decafAST* inputElse): expr(inputExpr), block(inputBlock), elseBlock(inputElse) {}
 	IfStmtAST(decafAST* inputExpr, decafAST* inputBlock): expr(inputExpr), block(inputBlock) { elseBlock = NULL;}
-	~IfStmtAST() { 
-		if (block != NULL) { delete block; } 
-		if (expr != NULL) { delete expr; }
-		if (elseBlock != NULL) { delete elseBlock; }
-	}
-	string str() {return string("IfStmt") + "("+ getString(expr) + "," + getString(block) + "," + getString(elseBlock) +")";}
+	void print(astSink &out) { out << "IfStmt(" << expr << "," << block << "," << elseBlock << ")"; }
 	llvm::Value *Codegen() { return 0;}
 };
 
@@ -331,11 +321,7 @@ class WhileStmtAST: public decafAST {
 	decafAST *block;
 public:
 	WhileStmtAST(decafAST* inputExpr, decafAST* inputBlock): expr(inputExpr), block(inputBlock) {}
-	~WhileStmtAST() { 
-		if (block != NULL) { delete block; } 
-		if (expr != NULL) { delete expr; }
-	}
-	string str() {return string("WhileStmt") + "("+ getString(expr) + "," + getString(block) + ")";}
+	void print(astSink &out) { out << "WhileStmt(" << expr << "," << block << ")"; }
 	llvm::Value *Codegen() { return 0;}
 };
 
@@ -347,8 +333,7 @@ class AssignVarAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignVarAST(string name, decafAST* expr): Name(name), Expr(expr) {}
-	~AssignVarAST() { if(Expr != NULL) { delete Expr; }}
-	string str() { return string("AssignVar") + "("+ Name + "," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignVar(" << Name << "," << Expr << ")"; }
 	llvm::Value* Codegen(){
 		llvm::AllocaInst* Alloca;
 		llvm::Value *val;
@@ -378,11 +363,7 @@ class AssignArrayLocAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignArrayLocAST(decafAST* lval ,decafAST* expr): Lval(lval) ,Expr(expr) {}
-	~AssignArrayLocAST() { 
-		if(Expr != NULL) { delete Expr; }
-		if(Lval != NULL) { delete Lval; }
-	}
-	string str() { return string("AssignArrayLoc") + "("+ getString(Lval) +"," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignArrayLoc(" << Lval << "," << Expr << ")"; }
 	 llvm::Value *Codegen() { return 0;}
 };
 
@@ -393,7 +374,7 @@ class MethodArgAST: public decafAST {
 public:
 	MethodArgAST(string value): Value(value) {}
 	string getValue() { return Value;}
-	string str() { return string("StringConstant") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "StringConstant(" << Value << ")"; }
 	llvm::Value* Codegen() {
 		string temp = Value;
 		temp.erase(temp.begin());
@@ -444,7 +425,7 @@ class VariableExprAST: public decafAST {
 	string Name;
 public:
 	VariableExprAST(string name): Name(name) {}
-	string str() { return string("VariableExpr") + "(" + Name + ")" ;}
+	void print(astSink &out) { out << "VariableExpr(" << Name << ")"; }
 	 llvm::Value *Codegen() { 
 	 	llvm::Value *V = access_symtbl(Name);
 	 //	if(V != NULL)
@@ -460,8 +441,7 @@ class ArrayLocExprAST : public decafAST {
 	decafAST* Index;
 public:
 	ArrayLocExprAST(string name, decafAST* index): Name(name), Index(index) {}
-	~ArrayLocExprAST() { if(Index != NULL) { delete Index; }}
-	string str() { return string("ArrayLocExpr") + "("+ Name + "," + getString(Index) + ")" ;}
+	void print(astSink &out) { out << "ArrayLocExpr(" << Name << "," << Index << ")"; }
 	 llvm::Value *Codegen() { return 0;}
 };
 
@@ -471,8 +451,7 @@ class ArrayLValAST : public decafAST {
 	decafAST* Index;
 public:
 	ArrayLValAST(string name, decafAST* index): Name(name), Index(index) {}
-	~ArrayLValAST() { if(Index != NULL) { delete Index; }}
-	string str() { return string( Name + "," + getString(Index) ) ;}
+	void print(astSink &out) { out << Name << "," << Index; }
 	 llvm::Value *Codegen() { return 0;}
 };
 
@@ -485,7 +464,7 @@ class NumberExprAST: public decafAST {
 	string Value;
 public:
 	NumberExprAST(string value): Value(value) {}
-	string str() { return string("NumberExpr") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "NumberExpr(" << Value << ")"; }
 	llvm::Value* Codegen(){
 		return Builder.getInt32(stoi(Value));
 	}
@@ -496,7 +475,7 @@ class BoolExprAST: public decafAST {
 	string Value;
 public:
 	BoolExprAST(string value): Value(value) {}
-	string str() { return string("BoolExpr") + "(" + Value + ")" ;}
+	void print(astSink &out) { out << "BoolExpr(" << Value << ")"; }
 	llvm::Value* Codegen(){
 		if(Value == "True")
 			return Builder.getInt1(1);
@@ -515,11 +494,7 @@ class BinaryExprAST : public decafAST {
 	decafAST* Right;
 public:
 	BinaryExprAST(string op,decafAST* left ,decafAST* right): Op(op), Left(left) , Right(right) {}
-	~BinaryExprAST() { 
-		if(Left != NULL) { delete Left; }
-		if(Right != NULL) { delete Right; }
-	}
-	string str() { return string("BinaryExpr") + "("+ Op + "," + getString(Left) +"," + getString(Right) + ")" ;}
+	void print(astSink &out) { out << "BinaryExpr(" << Op << "," << Left << "," << Right << ")"; }
 	llvm::Value *Codegen() {
 	  llvm::Value *L = Left->Codegen();
 	  llvm::Value *R = Right->Codegen();
@@ -572,8 +547,7 @@ class UnaryExprAST : public decafAST {
 	decafAST* Value;
 public:
 	UnaryExprAST(string op, decafAST* value): Op(op), Value(value) {}
-	~UnaryExprAST() { if(Value != NULL) { delete Value; }}
-	string str() { return string("UnaryExpr") + "("+ Op + "," + getString(Value) + ")" ;}
+	void print(astSink &out) { out << "UnaryExpr(" << Op << "," << Value << ")"; }
 	llvm::Value* Codegen(){
 		llvm::Value *V = Value->Codegen();
 		if(Op == "UnaryMinus")
@@ -590,11 +564,7 @@ class MethodBlockAST : public decafAST {
 	decafStmtList *statement_list;
 public:
 	MethodBlockAST(decafStmtList* vList, decafStmtList* sList): varDefList(vList), statement_list(sList) {} 
-	~MethodBlockAST(){ 
-		if(varDefList != NULL) {delete varDefList;}
-		if(statement_list != NULL) {delete statement_list;}
-	}
-	string str() { return string("MethodBlock") + "(" + getString(varDefList) + "," + getString(statement_list) + ")"; }
+	void print(astSink &out) { out << "MethodBlock(" << varDefList << "," << statement_list << ")"; }
 	llvm::Value* Codegen(){
 		llvm::Value *val = NULL;
 		llvm::Function *func= Builder.GetInsertBlock()->getParent();
@@ -632,11 +602,7 @@ class MethodDeclAST: public decafAST {
 	decafAST* MBlock;
 public:
 	MethodDeclAST(string name, decafStmtList* list, string type, decafAST* block ) : Name(name), DecVarList(list), MType(type), MBlock(block) {}
-	~MethodDeclAST(){ 
-		if(DecVarList != NULL) {delete DecVarList;}
-		if(MBlock != NULL) {delete MBlock;}
-	}
-	string str() { return string("Method") + "("+ Name + "," + MType + "," + getString(DecVarList) + "," + getString(MBlock)+ ")"; }
+	void print(astSink &out) { out << "Method(" << Name << "," << MType << "," << DecVarList << "," << MBlock << ")"; }
 	llvm::Value *Codegen(){
 		llvm::Type *returnTy= getLLVMType(MType);
 		llvm::Function *func = NULL;
@@ -693,11 +659,8 @@ class MethodCallAST	: public decafAST {
 	decafStmtList *method_arg_list;
 public:
 	MethodCallAST(string name, decafStmtList *mArgList): Name(name), method_arg_list(mArgList) {}
-	~MethodCallAST() { 
-		if (method_arg_list != NULL) { delete method_arg_list; }
-	}
-	string str() { 
-		return string("MethodCall") + "(" + Name + "," + getString(method_arg_list) + ")";
+	void print(astSink &out) {
+		out << "MethodCall(" << Name << "," << method_arg_list << ")";
 	}
 	llvm::Value* Codegen(){
 
@@ -732,7 +695,7 @@ class ParenExprAST: public decafAST {
 	decafAST* Value;
 public:
 	ParenExprAST(decafAST* value): Value(value) {}
-	string str() { return "(" + getString(Value) + ")" ;}
+	void print(astSink &out) { out << "(" << Value << ")"; }
 	 llvm::Value *Codegen() { return Value->Codegen();}
 };
 
@@ -741,7 +704,7 @@ class ExternTypeAST : public decafAST {
 	string Name;
 public:
 	ExternTypeAST(string name): Name(name) {}
-	string str() { return string("VarDef") + "(" + Name + ")" ;}
+	void print(astSink &out) { out << "VarDef(" << Name << ")"; }
 	 llvm::Value *Codegen() { 
 	 	return (llvm::Value*)getLLVMType(Name);
 	}
@@ -757,8 +720,7 @@ class ExternFunctionAST : public decafAST {
 	decafAST* InputType;
 public:
 	ExternFunctionAST(string name, string returnType, decafAST* inputType): Name(name), ReturnType(returnType), InputType(inputType) {}
-	~ExternFunctionAST() { if(InputType != NULL) {delete InputType;}}
-	string str() { return string("ExternFunction") + "(" + Name + "," + ReturnType + "," + getString(InputType) + ")" ;}
+	void print(astSink &out) { out << "ExternFunction(" << Name << "," << ReturnType << "," << InputType << ")"; }
 	 llvm::Value *Codegen() { 
 	 	llvm::Type *returnTy = getLLVMType(ReturnType);
 	 	vector<llvm::Type *> args = ((decafStmtList*)InputType)->returnArgsE();
@@ -780,12 +742,9 @@ class FieldDeclAST : public decafAST {
 
 public:
 	FieldDeclAST(decafAST* name, string type, string fSize): Name(name), Type(type), FSize(fSize) {}
-	~FieldDeclAST() {
-		if(Name != NULL) {delete Name;}
-	}
 	string returnType() { return Type;}
 	string returnArr() { return FSize;}
-	string str() {return string("FieldDecl") + "(" + getString(Name) + "," + Type + "," + FSize + ")" ;}
+	void print(astSink &out) { out << "FieldDecl(" << Name << "," << Type << "," << FSize << ")"; }
 	llvm::Value *Codegen() { throw runtime_error("FieldDecl");}
 
 };
@@ -797,7 +756,7 @@ class ArrayAST: public decafAST {
 	string ArrSize;
 public:
 	ArrayAST(string arrSize): ArrSize(arrSize) {}
-	string str() { return string("Array") + "(" + ArrSize + ")" ;}
+	void print(astSink &out) { out << "Array(" << ArrSize << ")"; }
 	 llvm::Value *Codegen() { return 0;}
 
 };
@@ -806,7 +765,7 @@ public:
 class ScalarAST: public decafAST {
 public:
 	ScalarAST() {}
-	string str() {return string("Scalar");}
+	void print(astSink &out) { out << "Scalar"; }
 	llvm::Value *Codegen() { throw runtime_error("scalar");}
 
 };
@@ -819,8 +778,7 @@ class AssignGlobalVarAST : public decafAST {
 	decafAST* Expr;
 public:
 	AssignGlobalVarAST(string name, string type, decafAST* expr): Name(name), Type(type), Expr(expr) {}
-	~AssignGlobalVarAST() {if(Expr != NULL) {delete Expr;}}
-	string str() {return string("AssignGlobalVar") + "(" + Name + "," + Type + "," + getString(Expr) + ")" ;}
+	void print(astSink &out) { out << "AssignGlobalVar(" << Name << "," << Type << "," << Expr << ")"; }
 	 llvm::Value *Codegen() { return 0;}
 };
 
@@ -833,7 +791,6 @@ class MethodAST : public decafAST {
 	decafAST* MBlock;
 public:
 	MethodAST(string name, string type, decafAST* mBlock): Name(name), Type(Type), MBlock(mBlock) {}
-	~MethodAST() {if(MBlock != NULL) {delete MBlock;}}
 	string str() {return string("FieldDecl") + "(" + Name + "," + Type + "," + getString(MBlock) + ")" ;}
 };
 */
@@ -842,7 +799,7 @@ class IdAST: public decafAST {
 	string Name;
 public:
 	IdAST(string name): Name(name) {}
-	string str() {return Name;}
+	void print(astSink &out) { out << Name; }
 	llvm::Value *Codegen() { throw runtime_error("idast");}
 };
 
@@ -13,6 +13,8 @@ int yyerror(char *);
 
 // print AST?
 bool printAST = false;
+// report arena usage?
+bool printStats = false;
 
 using namespace std;
 
@@ -44,6 +46,7 @@ llvm::Function *gen_main_def() {
 %union{
     class decafAST *ast;
     std::string *sval;
+    tokenText tok;
  }
 
 %token T_BOOLTYPE
@@ -90,11 +93,11 @@ llvm::Function *gen_main_def() {
 %token T_AND
 %token T_OR
 %token T_DOT
-%token <sval> T_ID
+%token <tok> T_ID
 
-%token <sval> T_INTCONSTANT
-%token <sval> T_CHARCONSTANT
-%token <sval> T_STRINGCONSTANT
+%token <tok> T_INTCONSTANT
+%token <tok> T_CHARCONSTANT
+%token <tok> T_STRINGCONSTANT
 
 //%token T_COMMENT
 
@@ -115,7 +118,8 @@ program: extern_list decafpackage
     { 
         ProgramAST *prog = new ProgramAST((decafStmtList *)$1, (PackageAST *)$2); 
 		if (printAST) {
-			cout << getString(prog) << endl;
+			astSink out(stdout);
+			out << prog << "\n";
 		}
 		try {
             prog->Codegen();
@@ -125,7 +129,10 @@ program: extern_list decafpackage
             //cout << prog->str() << endl; 
             exit(EXIT_FAILURE);
         }
-        delete prog;
+        if (printStats) {
+            astArena.printStats(cerr);
+        }
+        astArena.reset();
     }
 
 extern_list: externR
@@ -137,7 +144,7 @@ extern_list: externR
     ;
 
 decafpackage: T_PACKAGE T_ID T_LCB field-decR method-dec-list T_RCB
-    { $$ = new PackageAST(*$2, (decafStmtList*)$4, (decafStmtList*)$5); delete $2; }
+    { $$ = new PackageAST($2.str(), (decafStmtList*)$4, (decafStmtList*)$5); }
     ;
 
 block : T_LCB var-decl-list statements T_RCB {$$ = new BlockAST((decafStmtList *)$2, (decafStmtList *)$3);}
@@ -161,19 +168,19 @@ id_list_var: T_ID T_COMMA id_list_var {
 		decafStmtList *slist = (decafStmtList*) $3;
 		VarDefAST* last = (VarDefAST*) (slist -> lastElement());
 		string type = last -> returnType();
-		$$ = new VarDefAST(*$1,type);
+		$$ = new VarDefAST($1.str(),type);
 		slist -> push_front($$);
 		$$ = slist;
 	}
-	| T_ID decaf_type { decafStmtList *slist = new decafStmtList(); $$ = new VarDefAST(*$1,*$2); slist -> push_front($$); $$ = slist; delete $1; delete $2;}
+	| T_ID decaf_type { decafStmtList *slist = new decafStmtList(); $$ = new VarDefAST($1.str(),*$2); slist -> push_front($$); $$ = slist;}
 	;
 
 
-decaf_type: T_INTTYPE {$$ = new std::string("IntType");}
-	| T_BOOLTYPE	{$$ = new std::string("BoolType");}
+decaf_type: T_INTTYPE {$$ = astArena.newString("IntType");}
+	| T_BOOLTYPE	{$$ = astArena.newString("BoolType");}
 	;
 
-method_type: T_VOID {$$ = new std::string("VoidType");}
+method_type: T_VOID {$$ = astArena.newString("VoidType");}
 	| decaf_type	{$$ = $1;}
 	;
 
@@ -182,7 +189,7 @@ extern_type: T_STRINGTYPE
 		std::string temp = "StringType";
 		$$ = new ExternTypeAST(temp); 
 	}
-	| decaf_type { $$ = new ExternTypeAST(*$1) ; delete $1;}
+	| decaf_type { $$ = new ExternTypeAST(*$1) ;}
 	;
 
 extern_typeR: extern_type T_COMMA extern_typeR  
@@ -201,10 +208,10 @@ extern_typeR: extern_type T_COMMA extern_typeR
 	;
 
 
-const: T_INTCONSTANT {$$ = new NumberExprAST(*$1); delete $1;}
+const: T_INTCONSTANT {$$ = new NumberExprAST($1.str());}
 	| T_CHARCONSTANT 
 	{
-		std::string str = *$1;
+		std::string str = $1.str();
 		char *c = new char();
 		*c = str[1];
 		int temp = int(*c);
@@ -261,7 +268,6 @@ const: T_INTCONSTANT {$$ = new NumberExprAST(*$1); delete $1;}
 		str = std::to_string(temp);
 		delete c;
 		$$ = new NumberExprAST(str);
-		delete $1;
 	}
 	| bool_const	 {$$ = $1;}
 	;
@@ -281,81 +287,81 @@ assignR: assign assignR
 
 assign: T_ID T_ASSIGN expr 
 	{
-		$$ = new AssignVarAST(*$1,$3); delete $1;
+		$$ = new AssignVarAST($1.str(),$3);
 	}
 	| lvalue T_ASSIGN expr { $$ = new AssignArrayLocAST($1,$3);}
 	;
 
-lvalue: T_ID T_LSB expr T_RSB { $$ = new ArrayLValAST(*$1,$3); delete $1;}	
+lvalue: T_ID T_LSB expr T_RSB { $$ = new ArrayLValAST($1.str(),$3);}	
 
 
 
- expr : expr boolOr expr1  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+ expr : expr boolOr expr1  { $$ = new BinaryExprAST(*$2,$1,$3);}
 	| expr1
 	;
 
-expr1 : expr1 boolAnd expr2  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr1 : expr1 boolAnd expr2  { $$ = new BinaryExprAST(*$2,$1,$3);}
 	| expr2
 	;
 
-expr2 : expr2 boolRest expr3  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr2 : expr2 boolRest expr3  { $$ = new BinaryExprAST(*$2,$1,$3);}
 	| expr3
 	;
 
-expr3 : expr3 plusMinus expr4  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr3 : expr3 plusMinus expr4  { $$ = new BinaryExprAST(*$2,$1,$3);}
 	| expr4
 	;
 
-expr4 : expr4 arithRest expr5  { $$ = new BinaryExprAST(*$2,$1,$3); delete $2;}
+expr4 : expr4 arithRest expr5  { $$ = new BinaryExprAST(*$2,$1,$3);}
 	| expr5
 	;
 
-expr5 : unaryNot expr5  { $$ = new UnaryExprAST(*$1,$2), delete $1;}
-	| unaryNot expr6  { $$ = new UnaryExprAST(*$1,$2), delete $1;}
+expr5 : unaryNot expr5  { $$ = new UnaryExprAST(*$1,$2);}
+	| unaryNot expr6  { $$ = new UnaryExprAST(*$1,$2);}
 	| expr6
 	;
 
-expr6 : unaryMinus expr6  { $$ = new UnaryExprAST(*$1,$2), delete $1;} 
-	| unaryMinus expr7  { $$ = new UnaryExprAST(*$1,$2), delete $1;}
+expr6 : unaryMinus expr6  { $$ = new UnaryExprAST(*$1,$2);} 
+	| unaryMinus expr7  { $$ = new UnaryExprAST(*$1,$2);}
 	| expr7
 	;
 
-expr7 : T_ID T_LSB expr T_RSB { $$ = new ArrayLocExprAST(*$1,$3); delete $1;}
-	| T_ID {$$ = new VariableExprAST(*$1); delete $1; }
+expr7 : T_ID T_LSB expr T_RSB { $$ = new ArrayLocExprAST($1.str(),$3);}
+	| T_ID {$$ = new VariableExprAST($1.str()); }
 	| const {$$ = $1;}
 	| T_LPAREN expr T_RPAREN { $$ = $2;}
 	| method_call {$$ = $1;}
 	;
 
-unaryNot: T_NOT {$$ = new std::string("Not");}
+unaryNot: T_NOT {$$ = astArena.newString("Not");}
 
-unaryMinus: T_MINUS {$$ = new std::string("UnaryMinus");}
+unaryMinus: T_MINUS {$$ = astArena.newString("UnaryMinus");}
 
-arithRest : T_MULT	{$$ = new std::string("Mult");}
-	| T_DIV		{$$ = new std::string("Div");}
-	| T_MOD		{$$ = new std::string("Mod");}
-	| T_LBW		{$$ = new std::string("Leftshift");}
-	| T_RBW		{$$ = new std::string("Rightshift");}
+arithRest : T_MULT	{$$ = astArena.newString("Mult");}
+	| T_DIV		{$$ = astArena.newString("Div");}
+	| T_MOD		{$$ = astArena.newString("Mod");}
+	| T_LBW		{$$ = astArena.newString("Leftshift");}
+	| T_RBW		{$$ = astArena.newString("Rightshift");}
 	;
 
-plusMinus : T_PLUS {$$ = new std::string("Plus");}
-	| T_MINUS	{$$ = new std::string("Minus");}
+plusMinus : T_PLUS {$$ = astArena.newString("Plus");}
+	| T_MINUS	{$$ = astArena.newString("Minus");}
 	;
 
-boolRest : T_EQ 	{$$ = new std::string("Eq");}
-	| T_NEQ 		{$$ = new std::string("Neq");}
-	| T_LT 			{$$ = new std::string("Lt");}
-	| T_LEQ			{$$ = new std::string("Leq");}
-	| T_GT 			{$$ = new std::string("Gt");}
-	| T_GEQ 		{$$ = new std::string("Geq");}
+boolRest : T_EQ 	{$$ = astArena.newString("Eq");}
+	| T_NEQ 		{$$ = astArena.newString("Neq");}
+	| T_LT 			{$$ = astArena.newString("Lt");}
+	| T_LEQ			{$$ = astArena.newString("Leq");}
+	| T_GT 			{$$ = astArena.newString("Gt");}
+	| T_GEQ 		{$$ = astArena.newString("Geq");}
 	;
 
-boolAnd : T_AND			{$$ = new std::string("And");}
-boolOr  : T_OR 			{$$ = new std::string("Or");}
+boolAnd : T_AND			{$$ = astArena.newString("And");}
+boolOr  : T_OR 			{$$ = astArena.newString("Or");}
 
 
 method_call: T_ID T_LPAREN method-arg-list T_RPAREN 
-	{ $$ = new MethodCallAST(*$1,(decafStmtList*)$3); delete $1;}
+	{ $$ = new MethodCallAST($1.str(),(decafStmtList*)$3);}
 
 method-arg-list: method-arg T_COMMA method-arg-list
 	{
@@ -368,13 +374,12 @@ method-arg-list: method-arg T_COMMA method-arg-list
 	;
 
 method-arg: expr {$$ = $1;}
-	| T_STRINGCONSTANT {$$ = new MethodArgAST(*$1); delete $1;}
+	| T_STRINGCONSTANT {$$ = new MethodArgAST($1.str());}
 	;
 
 arrayType : T_LSB T_INTCONSTANT T_RSB
 	{
-		$$ = new ArrayAST(*$2);
-		delete $2;
+		$$ = new ArrayAST($2.str());
 	}
 	;
 
@@ -424,7 +429,7 @@ method-dec-list : method-dec method-dec-list
 	;
 
 method-dec: T_FUNC T_ID T_LPAREN dec-var-structR T_RPAREN method_type mBlock
-	{$$ = new MethodDeclAST(*$2,(decafStmtList*)$4,*$6,$7); delete $2; delete $6;}
+	{$$ = new MethodDeclAST($2.str(),(decafStmtList*)$4,*$6,$7);}
 	| { decafStmtList *slist = new decafStmtList(); $$ = slist; }
 	;
 
@@ -441,7 +446,7 @@ dec-var-structR: dec-var-struct T_COMMA dec-var-structR
 	| { decafStmtList *slist = new decafStmtList(); $$ = slist; }
 	;
 
-dec-var-struct: T_ID decaf_type { $$ = new VarDefAST(*$1,*$2); delete $1; delete $2;}
+dec-var-struct: T_ID decaf_type { $$ = new VarDefAST($1.str(),*$2);}
 
 field-decR: field-dec field-decR
 	{
@@ -459,17 +464,15 @@ field-dec: T_VAR mul-field-decR T_SEMICOLON
 	}
 	| T_VAR T_ID decaf_type T_SEMICOLON
 	{
-		IdAST* temp = new IdAST(*$2);
+		IdAST* temp = new IdAST($2.str());
 		$$ = new FieldDeclAST((decafAST*)temp,*$3, "Scalar");
-		delete $3;
 	}
 	| T_VAR mul-arr-decR T_SEMICOLON {$$ = $2;}
-	| T_VAR T_ID arrayType decaf_type T_SEMICOLON { IdAST* temp = new IdAST(*$2); $$ = new FieldDeclAST((decafAST*)temp, *$4, getString($3)); delete $2;}
+	| T_VAR T_ID arrayType decaf_type T_SEMICOLON { IdAST* temp = new IdAST($2.str()); $$ = new FieldDeclAST((decafAST*)temp, *$4, getString($3));}
 	| T_VAR T_ID decaf_type T_ASSIGN const T_SEMICOLON
 	{
-		$$ = new AssignGlobalVarAST(*$2,*$3,$5);
-		delete $2;
-		delete $3;
+		$$ = new AssignGlobalVarAST($2.str(),*$3,$5);
+
 	}
 	;
 
@@ -477,12 +480,12 @@ mul-field-decR: T_ID T_COMMA mul-field-decR {
 		decafStmtList* sList = (decafStmtList*) $3;
 		FieldDeclAST* last = (FieldDeclAST*)(sList -> lastElement());
 		string type = last -> returnType(); 
-		IdAST* temp = new IdAST(*$1);
+		IdAST* temp = new IdAST($1.str());
 		$$ = new FieldDeclAST((decafAST*)temp,type, "Scalar");
 		sList -> push_front($$);
 		$$ = sList;
 	}
-	| T_ID decaf_type	{ decafStmtList* sList = new decafStmtList(); IdAST* temp = new IdAST(*$1); $$ = new FieldDeclAST(temp,*$2, "Scalar"); sList-> push_front($$); $$ = sList; }
+	| T_ID decaf_type	{ decafStmtList* sList = new decafStmtList(); IdAST* temp = new IdAST($1.str()); $$ = new FieldDeclAST(temp,*$2, "Scalar"); sList-> push_front($$); $$ = sList; }
 	;
 
 mul-arr-decR: T_ID T_COMMA mul-arr-decR { 
@@ -490,12 +493,12 @@ mul-arr-decR: T_ID T_COMMA mul-arr-decR {
 		FieldDeclAST* last = (FieldDeclAST*)(sList -> lastElement());
 		string type = last -> returnType(); 
 		string arrT = last -> returnArr();
-		IdAST* temp = new IdAST(*$1);
+		IdAST* temp = new IdAST($1.str());
 		$$ = new FieldDeclAST((decafAST*)temp,type, arrT);
 		sList -> push_front($$);
 		$$ = sList;
 	}
-	| T_ID arrayType decaf_type	{ decafStmtList* sList = new decafStmtList(); IdAST* temp = new IdAST(*$1); $$ = new FieldDeclAST(temp,*$3, getString($2)); sList-> push_front($$); $$ = sList; }
+	| T_ID arrayType decaf_type	{ decafStmtList* sList = new decafStmtList(); IdAST* temp = new IdAST($1.str()); $$ = new FieldDeclAST(temp,*$3, getString($2)); sList-> push_front($$); $$ = sList; }
 	;
 
 
@@ -514,9 +517,8 @@ externR: extern externR
 	;
 extern: T_EXTERN T_FUNC T_ID T_LPAREN extern_typeR T_RPAREN method_type T_SEMICOLON
 	{
-		$$ = new ExternFunctionAST(*$3, *$7, $5);
-		delete $3;
-		delete $7;
+		$$ = new ExternFunctionAST($3.str(), *$7, $5);
+
 	}
 	
       
@@ -526,7 +528,15 @@ extern: T_EXTERN T_FUNC T_ID T_LPAREN extern_typeR T_RPAREN method_type T_SEMICO
 
 %%
 
-int main() {
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--stats") == 0) {
+      printStats = true;
+    } else {
+      cerr << "usage: " << argv[0] << " [--stats]" << endl;
+      return EXIT_FAILURE;
+    }
+  }
   // initialize LLVM
   llvm::LLVMContext &Context = TheContext;
   // Make the module, which holds all the code.
@@ -539,6 +549,8 @@ int main() {
   // set up dummy main function
   //TheFunction = gen_main_def();
   // parse the input and create the abstract syntax tree
+  // scan a redirected source file in place, pipes go through flex's own buffer
+  yymapinput(fileno(stdin));
   int retval = yyparse();
   // remove symbol table
 